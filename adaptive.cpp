@@ -0,0 +1,136 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "adaptive.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+//a sampled score this close to min_score gets its neighbours classified
+static const float kNearScore = 0.15;
+
+//first pass: every stride-th second
+static ScoreMatrix CoarsePass(BatchScheduler* scheduler, FrameGrabber* grabber,
+        int num_labels, int stride, const boost::function<void(int)>& progress,
+        int* seconds)
+{
+    ScoreJob job(num_labels);
+    int submitted = 0;
+    *seconds = 0;
+    cv::Mat frame;
+    while(grabber->Next(*seconds % stride == 0 ? &frame : NULL))
+    {
+        if(*seconds % stride == 0)
+        {
+            if(!scheduler->Submit(&job, *seconds / stride, frame))
+                break;
+            submitted++;
+        }
+        (*seconds)++;
+        if(progress)
+            progress(*seconds);
+    }
+    scheduler->Finish(&job, submitted);
+    return job.Wait();
+}
+
+//which coarse intervals [i*stride, (i+1)*stride] need every second
+static vector<bool> IntervalsToRefine(const ScoreMatrix& coarse, float min_score)
+{
+    int rows = coarse.rows();
+    vector<int> winners(rows);
+    vector<float> vals(rows);
+    if(rows > 0)
+        scoreArgMaxRows(coarse.data(), rows, coarse.cols(), &winners[0], &vals[0]);
+
+    //a score crossing min_score can start or end a cut anywhere in
+    //between, however far from min_score both samples are
+    vector<bool> refine(rows, false);
+    for(int i=0; i + 1 < rows; i++)
+        refine[i] = winners[i] != winners[i+1] ||
+            (vals[i] >= min_score) != (vals[i+1] >= min_score) ||
+            fabs(vals[i] - min_score) < kNearScore ||
+            fabs(vals[i+1] - min_score) < kNearScore;
+    return refine;
+}
+
+bool ScoreMovieAdaptive(BatchScheduler* scheduler, FrameGrabber* grabber,
+        int num_labels, int stride, float min_score,
+        const boost::function<void(int)>& progress, ScoreMatrix* scores, int* classified)
+{
+    int seconds;
+    ScoreMatrix coarse = CoarsePass(scheduler, grabber, num_labels, stride, progress, &seconds);
+    int samples = coarse.rows();
+    vector<bool> refine = IntervalsToRefine(coarse, min_score);
+
+    //second pass: seek to each run of intervals to refine and read it
+    //through. The seconds after the last sample are always read.
+    ScoreJob job(num_labels);
+    vector<int> dense_seconds;
+    scheduler->Begin();
+    bool read_all = true;
+    int i = 0;
+    while(i < samples && read_all)
+    {
+        bool tail = i == samples - 1;
+        if(!tail && !refine[i])
+        {
+            i++;
+            continue;
+        }
+        int first = i * stride + 1;
+        int end = tail ? seconds : i * stride + stride;
+        while(!tail && i + 1 < samples - 1 && refine[i+1])
+        {
+            i++;
+            end = i * stride + stride;
+        }
+        i++;
+
+        if(first >= end)
+            continue;
+        if(!grabber->Seek(first))
+        {
+            read_all = false;
+            break;
+        }
+        cv::Mat frame;
+        for(int s=first; s < end && grabber->Next(&frame); s++)
+        {
+            if(!scheduler->Submit(&job, dense_seconds.size(), frame))
+                break;
+            dense_seconds.push_back(s);
+        }
+    }
+    scheduler->Finish(&job, dense_seconds.size());
+    ScoreMatrix dense = job.Wait();
+    if(!read_all)
+        return false;
+
+    //samples, then interpolation, then the refined seconds on top
+    ScoreMatrix& out = *scores;
+    out = ScoreMatrix(num_labels);
+    out.Resize(seconds);
+    for(int s=0; s < seconds; s++)
+    {
+        int a = min(s / stride, samples - 1);
+        int b = min(a + 1, samples - 1);
+        float w = (a == b) ? 0 : (float)(s - a * stride) / stride;
+        const float* ra = coarse.row(a);
+        const float* rb = coarse.row(b);
+        float* row = out.row(s);
+        for(int j=0; j < num_labels; j++)
+            row[j] = (1 - w) * ra[j] + w * rb[j];
+    }
+    for(int d=0; d < dense_seconds.size(); d++)
+        copy(dense.row(d), dense.row(d) + num_labels, out.row(dense_seconds[d]));
+
+    if(classified)
+        *classified = samples + dense_seconds.size();
+    return true;
+}
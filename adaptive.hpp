@@ -0,0 +1,30 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef ADAPTIVE_HPP
+#define ADAPTIVE_HPP
+
+#include <boost/function.hpp>
+#include "cut_movie.hpp"
+#include "frame_grabber.hpp"
+#include "scheduler.hpp"
+
+//Coarse to fine sampling. Classify every stride-th second first, then go
+//back for the seconds in between only where it matters: where the winning
+//label changes from one sample to the next, or where a winning score is
+//close to min_score. The other seconds get scores interpolated between
+//their two samples, which keeps the winner of both. A change that starts
+//and ends between two samples can be missed, so stride should stay below
+//the min cut and max gap in use.
+//
+//The scheduler must already count the movie as submitting (Begin).
+//Puts a score for every second in scores, like SubmitMovie and
+//ScoreJob::Wait. False if the seconds to refine couldn't be read again
+//(a pipe or a stream that can't seek back), as the scores would be
+//mostly guesses.
+bool ScoreMovieAdaptive(BatchScheduler* scheduler, FrameGrabber* grabber,
+        int num_labels, int stride, float min_score,
+        const boost::function<void(int)>& progress, ScoreMatrix* scores, int* classified);
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <caffe/caffe.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <boost/thread.hpp>
+
+#include "autotune.hpp"
+#include "classifier.hpp"
+#include "score_cache.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+const int kBatchSizes[] = {1, 2, 4, 8, 16, 32, 64};
+const int kNumBatchSizes = 7;
+
+//each setting runs for at least this many frames and batches, and stops
+//after kMaxSeconds once it has the batches
+const int kMinFrames = 64;
+const int kMinBatches = 3;
+const double kMaxSeconds = 3.0;
+
+//a bigger batch this much slower than the best isn't going to catch up
+const double kGiveUp = 0.9;
+
+//with Caffe on a GPU the memory that counts is the GPU's
+static bool OnGpu(const BackendOptions& backend)
+{
+#ifdef CPU_ONLY
+    return false;
+#else
+    return backend.name == "caffe" && !backend.cpu;
+#endif
+}
+
+static double UsedMemoryMB(bool gpu)
+{
+#ifndef CPU_ONLY
+    if(gpu)
+    {
+        size_t free_bytes, total_bytes;
+        if(cudaMemGetInfo(&free_bytes, &total_bytes) != cudaSuccess)
+            return 0;
+        return (total_bytes - free_bytes) / 1048576.0;
+    }
+#endif
+    return residentMemoryMB();
+}
+
+static double TotalMemoryMB(bool gpu)
+{
+#ifndef CPU_ONLY
+    if(gpu)
+    {
+        size_t free_bytes, total_bytes;
+        if(cudaMemGetInfo(&free_bytes, &total_bytes) != cudaSuccess)
+            return 0;
+        return total_bytes / 1048576.0;
+    }
+#endif
+    return sysconf(_SC_PHYS_PAGES) * (sysconf(_SC_PAGESIZE) / 1048576.0);
+}
+
+//frames/s of a classifier with these settings. used_mb is what the
+//process has in use afterwards over base_mb.
+static double Measure(const BackendOptions& backend, const string& mean_file,
+        const string& label_file, int preprocess_threads, const vector<cv::Mat>& frames,
+        double base_mb, double* used_mb)
+{
+    Classifier classifier(backend, mean_file, label_file, preprocess_threads);
+    if(backend.int8)
+        classifier.Calibrate(frames);
+
+    //the batches go round the frames as many times as needed
+    int batch_size = backend.batch_size;
+    vector<cv::Mat> batches[2];
+    for(int i=0; i < 2; i++)
+        for(int j=0; j < batch_size; j++)
+            batches[i].push_back(frames[(i * batch_size + j) % frames.size()]);
+    vector<float> scores(batch_size * classifier.labels_.size());
+
+    //stage the next batch on another thread while this one runs, the
+    //way the scheduler does. The first two are a warm up.
+    StagedBatch staged[2];
+    classifier.Stage(batches[0], &staged[0]);
+    chrono::steady_clock::time_point start;
+    int timed = 0;
+    for(int k=0; ; k++)
+    {
+        if(k == 2)
+            start = chrono::steady_clock::now();
+        else if(k > 2)
+        {
+            timed++;
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            if(timed >= kMinBatches && (timed * batch_size >= kMinFrames ||
+                    elapsed.count() > kMaxSeconds))
+            {
+                *used_mb = UsedMemoryMB(OnGpu(backend)) - base_mb;
+                return timed * batch_size / elapsed.count();
+            }
+        }
+
+        int next = (k + 1) % 2;
+        boost::thread stage([&]() { classifier.Stage(batches[next], &staged[next]); });
+        classifier.Classify(&staged[k % 2], &scores[0]);
+        stage.join();
+    }
+}
+
+static vector<int> ThreadCounts()
+{
+    int cores = usableCores();
+    int counts[] = {cores, cores / 2, cores / 4, 1};
+    vector<int> out;
+    for(int i=0; i < 4; i++)
+        if(counts[i] >= 1 && find(out.begin(), out.end(), counts[i]) == out.end())
+            out.push_back(counts[i]);
+    return out;
+}
+
+bool ReadTuneSettings(const string& path, TuneSettings* settings)
+{
+    ifstream f(path.c_str());
+    if(!f)
+        return false;
+    f >> settings->batch_size >> settings->preprocess_threads >> settings->forward_threads
+        >> settings->frames_per_s;
+    settings->cached = true;
+    return f && settings->batch_size > 0 && settings->preprocess_threads > 0 &&
+        settings->forward_threads > 0;
+}
+
+static void WriteSettings(const string& path, const TuneSettings& settings)
+{
+    string mkdir_cmd = "mkdir -p \"" + getDirectory(path) + "\"";
+    if(system(mkdir_cmd.c_str()))
+    {
+        cerr << "Cannot create tuning cache: " << getDirectory(path) << endl;
+        return;
+    }
+
+    //a run started at the same time never reads half a file
+    string temp_path = path + "." + to_string(getpid());
+    ofstream f(temp_path.c_str());
+    f << settings.batch_size << " " << settings.preprocess_threads << " "
+        << settings.forward_threads << " " << settings.frames_per_s << endl;
+    f.close();
+    if(!f || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        cerr << "Cannot write tuning cache: " << path << endl;
+        remove(temp_path.c_str());
+    }
+}
+
+TuneSettings AutoTune(const BackendOptions& backend, const string& mean_file,
+        const string& label_file, const vector<cv::Mat>& frames, double memory_budget_mb,
+        const string& cache_file)
+{
+    TuneSettings best;
+    if(cache_file != "" && ReadTuneSettings(cache_file, &best))
+        return best;
+    best = TuneSettings();
+
+    bool gpu = OnGpu(backend);
+    if(memory_budget_mb <= 0)
+        memory_budget_mb = TotalMemoryMB(gpu) / 2;
+    double base_mb = UsedMemoryMB(gpu);
+    cout << "Auto-tuning on " << frames.size() << " frames " << frames[0].cols << "x"
+        << frames[0].rows << ", up to " << (int)memory_budget_mb << " MB" << endl;
+
+    BackendOptions options = backend;
+    vector<int> threads = ThreadCounts();
+    options.threads = threads[0];
+    best.forward_threads = threads[0];
+    best.preprocess_threads = threads[0];
+
+    auto try_settings = [&](int batch_size, int forward_threads, int preprocess_threads, double* used_mb) {
+        options.batch_size = batch_size;
+        options.threads = forward_threads;
+        double fps = Measure(options, mean_file, label_file, preprocess_threads, frames,
+                base_mb, used_mb);
+        cout << "  batch " << batch_size << ", " << forward_threads << " network threads, "
+            << preprocess_threads << " preprocess threads: " << fps << " frames/s, "
+            << (int)*used_mb << " MB" << endl;
+        if(*used_mb <= memory_budget_mb && fps > best.frames_per_s)
+        {
+            best.batch_size = batch_size;
+            best.forward_threads = forward_threads;
+            best.preprocess_threads = preprocess_threads;
+            best.frames_per_s = fps;
+        }
+        return fps;
+    };
+
+    //memory grows about linearly with the batch, so don't try one that
+    //would go over the budget
+    double used_mb = 0;
+    for(int i=0; i < kNumBatchSizes; i++)
+    {
+        int batch_size = kBatchSizes[i];
+        if(i > 0 && used_mb * batch_size / kBatchSizes[i - 1] > memory_budget_mb)
+            break;
+        double fps = try_settings(batch_size, best.forward_threads, best.preprocess_threads, &used_mb);
+        if(used_mb > memory_budget_mb || fps < kGiveUp * best.frames_per_s)
+            break;
+    }
+    if(best.batch_size == 0)
+    {
+        //not even one frame fits the budget, it's still better than nothing
+        best.batch_size = 1;
+        cerr << "Warning: a batch of 1 already takes more than " << (int)memory_budget_mb
+            << " MB" << endl;
+    }
+
+    //the threads only matter when the network runs on the CPU
+    for(int i=1; i < threads.size() && !gpu; i++)
+        try_settings(best.batch_size, threads[i], threads[0], &used_mb);
+    for(int i=1; i < threads.size(); i++)
+        try_settings(best.batch_size, best.forward_threads, threads[i], &used_mb);
+
+    if(cache_file != "")
+        WriteSettings(cache_file, best);
+    return best;
+}
+
+string TuneCacheFile(const string& cache_dir, uint64_t key)
+{
+    if(cache_dir == "")
+        return "";
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    key = HashString(string(host) + " cores=" + to_string(usableCores()), key);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx.tune", (unsigned long long)key);
+    return cache_dir + "/" + name;
+}
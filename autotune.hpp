@@ -0,0 +1,51 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "inference_backend.hpp"
+
+using namespace std;
+
+//the settings that make the classifier fastest on this machine
+struct TuneSettings
+{
+    TuneSettings() : batch_size(0), preprocess_threads(0), forward_threads(0),
+        frames_per_s(0), cached(false) {}
+
+    int batch_size;
+    int preprocess_threads;
+    int forward_threads;
+    double frames_per_s;
+    bool cached;  //read from an earlier run instead of measured
+};
+
+//Measures frames/s of the whole classifier (preprocessing one batch while
+//the network runs the last one, like a real run) on frames, first over
+//batch sizes, then over the threads of the network and of preprocessing,
+//keeping the best of each. Batch sizes that take more than memory_budget_mb
+//of memory (of the GPU with Caffe on a GPU, RAM otherwise) are not tried,
+//0 means half of it. backend gives everything else about the model.
+//
+//The result is kept in cache_file and read from there the next time,
+//an empty cache_file always measures.
+TuneSettings AutoTune(const BackendOptions& backend, const string& mean_file,
+        const string& label_file, const vector<cv::Mat>& frames, double memory_budget_mb,
+        const string& cache_file);
+
+//the settings kept in cache_file by an earlier AutoTune, false if there
+//aren't any
+bool ReadTuneSettings(const string& cache_file, TuneSettings* settings);
+
+//where the settings for key live in the cache directory ("" if it's off).
+//The key should cover the model and the resolution of the movies, the
+//host and the number of cores are added here.
+string TuneCacheFile(const string& cache_dir, uint64_t key);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Shared by the benchmarks. Results are printed one per line as
+//bench,case,value,unit so runs on different commits can be compared
+//line by line (see bench/compare.sh). Lower is better unless the unit
+//is a rate (per_s).
+
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//average time of one call in microseconds, after a warm up call
+template <typename F>
+double TimePerCall(int reps, F fn)
+{
+    fn();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i=0; i < reps; i++)
+        fn();
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / reps;
+}
+
+inline void Report(const string& bench, const string& name, double value, const string& unit)
+{
+    cout << bench << "," << name << "," << value << "," << unit << endl;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#!/bin/sh
+#Covered by the GPL. v3 (see included LICENSE)
+
+#Compares two outputs of run_benchmarks.sh: compare.sh old.csv new.csv
+#Changes worse than 5% are marked. Rates (per_s) are better higher,
+#everything else lower.
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 old.csv new.csv" >&2
+    exit 1
+fi
+
+awk -F, '
+NR == FNR { if(FNR > 1) old[$1 "," $2 "," $4] = $3; next }
+FNR > 1 {
+    key = $1 "," $2 "," $4
+    if(!(key in old) || old[key] == 0)
+        next
+    change = 100 * ($3 - old[key]) / old[key]
+    worse = ($4 ~ /per_s$/) ? -change : change
+    printf "%-12s %-28s %-16s %12g %12g %+8.1f%%%s\n", $1, $2, $4, old[key], $3, change,
+        (worse > 5) ? "  <-- slower" : ""
+}' "$1" "$2"
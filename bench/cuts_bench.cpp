@@ -0,0 +1,104 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//findTheCuts and TagTargets on synthetic score lists of a few hours,
+//scenes of random labels and lengths with noisy scores.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../cut_movie.hpp"
+#include "../util.hpp"
+#include "bench.hpp"
+
+using namespace std;
+
+static const char* kLabels[] = {"blowjob_handjob", "cunnilingus", "other", "sex_back",
+    "sex_front", "titfuck"};
+static const int kNumLabels = 6;
+
+//the same list every run, so commits can be compared
+ScoreMatrix SyntheticScores(int seconds)
+{
+    srand(1234);
+    ScoreMatrix scores(kNumLabels);
+    scores.Resize(seconds);
+    int label = 0;
+    int left = 0;
+    for(int i=0; i < seconds; i++)
+    {
+        if(left-- <= 0)
+        {
+            label = rand() % kNumLabels;
+            left = 5 + rand() % 120;
+        }
+
+        //mostly confident, sometimes another label wins for a second
+        float* row = scores.row(i);
+        for(int j=0; j < kNumLabels; j++)
+            row[j] = (float)(rand() % 100) / 100.0f;
+        if(rand() % 10 != 0)
+            row[label] += 4.0f;
+
+        float sum = 0;
+        for(int j=0; j < kNumLabels; j++)
+            sum += row[j];
+        for(int j=0; j < kNumLabels; j++)
+            row[j] /= sum;
+    }
+    return scores;
+}
+
+int main()
+{
+    vector<string> labels(kLabels, kLabels + kNumLabels);
+    vector<int> target_on(kNumLabels, 0);
+    target_on[0] = 1;
+
+    //TagTargets writes a tag file and prints every cut
+    string out_dir = makeTempDirectory("/tmp", "cuts_bench");
+    ostringstream sink;
+    streambuf* cout_buf = cout.rdbuf();
+
+    int hours[] = {2, 10};
+    for(int h=0; h < 2; h++)
+    {
+        int seconds = hours[h] * 3600;
+        string size = to_string(hours[h]) + "h";
+        ScoreMatrix scores = SyntheticScores(seconds);
+
+        vector<int> winners(seconds);
+        vector<float> vals(seconds);
+        double argmax_us = TimePerCall(20, [&]() {
+            scoreArgMaxRows(scores.data(), seconds, kNumLabels, &winners[0], &vals[0]);
+        });
+
+        cout.rdbuf(sink.rdbuf());
+        double find_us = TimePerCall(20, [&]() {
+            CutList cuts;
+            findTheCuts(seconds, winners, vals, target_on, labels[0], 4, 2, 0.5, 0.4, &cuts);
+        });
+        double tag_us = TimePerCall(5, [&]() {
+            CutList cuts;
+            string error;
+            TagTargets(scores, out_dir + "/movie.mp4", out_dir, labels, kNumLabels, 4, 2, 0.5, 0.4,
+                    &cuts, &error);
+        });
+        cout.rdbuf(cout_buf);
+        sink.str("");
+
+        Report("cuts", "argmax_" + size, argmax_us, "us");
+        Report("cuts", "find_cuts_" + size, find_us, "us");
+        Report("cuts", "find_cuts_" + size, seconds / (find_us / 1e6), "seconds_per_s");
+        Report("cuts", "tag_targets_" + size, tag_us, "us");
+    }
+
+    string clean_cmd = "rm -rf " + out_dir;
+    if(system(clean_cmd.c_str()))
+        cerr << "Could not remove " << out_dir << endl;
+    return 0;
+}
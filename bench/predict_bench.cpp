@@ -0,0 +1,70 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Forward pass throughput on the CPU against batch size, in float and
+//INT8, with the bundled model (or the one in the directory given). The
+//batch is staged once, so only the network is timed.
+
+#include <caffe/caffe.hpp>
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../classifier.hpp"
+#include "../int8_gemm.hpp"
+#include "bench.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    string model_dir = argc > 1 ? string(argv[1]) + "/" : "model/";
+
+    FLAGS_minloglevel = 3;
+    ::google::InitGoogleLogging(argv[0]);
+
+    vector<cv::Mat> frames;
+    for(int i=0; i < 32; i++)
+    {
+        cv::Mat img(360, 640, CV_8UC3);
+        cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+        frames.push_back(img);
+    }
+
+    int batch_sizes[] = {1, 4, 8, 16, 32};
+    for(int int8=0; int8 < 2; int8++)
+    {
+        string mode = int8 ? string("int8_") + Int8GemmKernel() : "float";
+        for(int b=0; b < 5; b++)
+        {
+            int batch_size = batch_sizes[b];
+            BackendOptions options;
+            options.model_file = model_dir + "deploy.prototxt";
+            options.trained_file = model_dir + "weights.caffemodel";
+            options.batch_size = batch_size;
+            options.int8 = int8;
+            //even when there is a GPU, it has to be chosen before the
+            //net is made for INT8
+            options.cpu = true;
+            Classifier classifier(options, model_dir + "mean.binaryproto",
+                    model_dir + "labels.txt");
+            if(int8)
+                classifier.Calibrate(frames);
+
+            vector<cv::Mat> batch(frames.begin(), frames.begin() + batch_size);
+            StagedBatch staged;
+            classifier.Stage(batch, &staged);
+            vector<float> scores(batch_size * classifier.labels_.size());
+
+            int reps = max(3, 64 / batch_size);
+            double us = TimePerCall(reps, [&]() { classifier.Classify(&staged, &scores[0]); });
+
+            string name = mode + "_batch" + to_string(batch_size);
+            Report("predict", name, us / batch_size, "us_per_frame");
+            Report("predict", name, batch_size / (us / 1e6), "frames_per_s");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Throughput of PreprocessFrame, which is all of Classifier::Preprocess
+//(color conversion, resize and the fused PackPlanarFloat), at a few
+//source resolutions and channel counts, next to the old convertTo /
+//subtract / split path it replaced.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../preprocess.hpp"
+#include "bench.hpp"
+
+using namespace std;
+
+static const cv::Size kInput(224, 224);
+static const float kMean[3] = {104.0f, 117.0f, 123.0f};
+
+//what Classifier::Preprocess used to do, kept as the baseline
+void OldPath(const cv::Mat& img, const cv::Mat& mean, vector<cv::Mat>* planes)
+{
+    cv::Mat sample_resized;
+    cv::resize(img, sample_resized, kInput);
+    cv::Mat sample_float;
+    sample_resized.convertTo(sample_float, CV_32FC3);
+    cv::Mat sample_normalized;
+    cv::subtract(sample_float, mean, sample_normalized);
+    cv::split(sample_normalized, *planes);
+}
+
+int main()
+{
+    string kernel = PackPlanarFloatKernel();
+
+    cv::Mat mean(kInput, CV_32FC3, cv::Scalar(kMean[0], kMean[1], kMean[2]));
+    vector<float> blob(3 * kInput.area());
+    vector<cv::Mat> planes;
+    for(int c=0; c < 3; c++)
+        planes.push_back(cv::Mat(kInput, CV_32FC1, &blob[c * kInput.area()]));
+
+    int sizes[][2] = {{320, 240}, {640, 360}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    for(int s=0; s < 5; s++)
+    {
+        cv::Mat img(sizes[s][1], sizes[s][0], CV_8UC3);
+        cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+        int reps = max(20, 200 * 1920 * 1080 / (int)img.total());
+
+        double old_us = TimePerCall(reps, [&]() { OldPath(img, mean, &planes); });
+        double fused_us = TimePerCall(reps, [&]() {
+            PreprocessFrame(img, kInput, 3, kMean, &blob[0]);
+        });
+
+        string size = to_string(img.cols) + "x" + to_string(img.rows);
+        Report("preprocess", "old_" + size, old_us, "us");
+        Report("preprocess", "fused_" + size, fused_us, "us");
+        Report("preprocess", "fused_" + size, 1e6 / fused_us, "frames_per_s");
+    }
+
+    //frames that need their color converted first, at 1280x720
+    cv::Mat bgr(720, 1280, CV_8UC3);
+    cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Mat bgra, gray;
+    cv::cvtColor(bgr, bgra, cv::COLOR_BGR2BGRA);
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+    double bgra_us = TimePerCall(200, [&]() { PreprocessFrame(bgra, kInput, 3, kMean, &blob[0]); });
+    double gray_us = TimePerCall(200, [&]() { PreprocessFrame(gray, kInput, 3, kMean, &blob[0]); });
+    double to_gray_us = TimePerCall(200, [&]() { PreprocessFrame(bgr, kInput, 1, kMean, &blob[0]); });
+    Report("preprocess", "fused_bgra_1280x720", bgra_us, "us");
+    Report("preprocess", "fused_gray_1280x720", gray_us, "us");
+    Report("preprocess", "fused_to_gray_1280x720", to_gray_us, "us");
+
+    //the pack step alone, already at network size
+    cv::Mat small(kInput, CV_8UC3);
+    cv::randu(small, cv::Scalar::all(0), cv::Scalar::all(255));
+    double scalar_us = TimePerCall(2000, [&]() {
+        PackPlanarFloatScalar(small.data, small.step, kInput.width, kInput.height, 3, kMean, &blob[0]);
+    });
+    double simd_us = TimePerCall(2000, [&]() {
+        PackPlanarFloat(small.data, small.step, kInput.width, kInput.height, 3, kMean, &blob[0]);
+    });
+    Report("preprocess", "pack_scalar", scalar_us, "us");
+    Report("preprocess", "pack_" + kernel, simd_us, "us");
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+#Covered by the GPL. v3 (see included LICENSE)
+
+#Runs every benchmark and prints the results as bench,case,value,unit.
+#The full runs classify, tag and cut a generated test video with the
+#miles-deep binary, so they need ffmpeg and are skipped without it.
+
+cd "$(dirname "$0")/.." || exit 1
+
+echo "bench,case,value,unit"
+./bench/preprocess_bench || exit 1
+./bench/cuts_bench || exit 1
+./bench/predict_bench || exit 1
+
+if ! command -v ffmpeg > /dev/null || [ ! -x ./miles-deep ]; then
+    echo "Skipping the full runs, they need ffmpeg and ./miles-deep" >&2
+    exit 0
+fi
+
+seconds=600
+tmp=$(mktemp -d /tmp/miles-deep-bench.XXXXXX) || exit 1
+ffmpeg -nostdin -loglevel error -f lavfi -i testsrc=duration=$seconds:size=1280x720:rate=30 \
+    -c:v mpeg4 -q:v 5 -g 60 "$tmp/test.mp4" || exit 1
+
+#report the time of a whole run and the stages in its timings
+run() {
+    name=$1
+    shift
+    start=$(date +%s.%N)
+    ./miles-deep -T "$tmp/$name.csv" "$@" > /dev/null || exit 1
+    end=$(date +%s.%N)
+    awk -v name="$name" -v s="$start" -v e="$end" -v n="$seconds" 'BEGIN {
+        printf "%s,wall,%g,s\n", name, e - s
+        printf "%s,video,%g,seconds_per_s\n", name, n / (e - s) }'
+    awk -F, -v name="$name" '$1 == "stage" {
+        printf "%s,%s,%s,total_s\n", name, $2, $5 }' "$tmp/$name.csv"
+}
+
+#classify and tag, then classify and cut, each without the score cache
+#so neither just reads the scores of the other
+run full_tag -a -C off -o "$tmp" "$tmp/test.mp4"
+run full_cut -t other -n -C off -d "$tmp" -o "$tmp" "$tmp/test.mp4"
+
+rm -rf "$tmp"
@@ -0,0 +1,134 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <caffe/caffe.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "caffe_backend.hpp"
+#include "fold_layers.hpp"
+#include "int8_layers.hpp"
+
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using namespace std;
+
+/* From OpenBLAS, which the Makefile links Caffe with. */
+extern "C" void openblas_set_num_threads(int num_threads);
+
+
+CaffeBackend::CaffeBackend(const BackendOptions& options)
+    : forward_pool_(options.int8 ? options.threads : 1)
+{
+#ifdef CPU_ONLY
+  Caffe::set_mode(Caffe::CPU);
+#else
+  Caffe::set_mode(options.cpu ? Caffe::CPU : Caffe::GPU);
+#endif
+  /* On the CPU the float layers run on the BLAS threads. */
+  if (Caffe::mode() == Caffe::CPU)
+    openblas_set_num_threads(options.threads);
+
+  /* Load the network. */
+  const string& trained_file = options.trained_file;
+  bool hdf5 = trained_file.size() > 3 &&
+      trained_file.compare(trained_file.size() - 3, 3, ".h5") == 0;
+  CHECK(!options.int8 || !hdf5) << "INT8 mode needs .caffemodel weights.";
+  CHECK(!options.int8 || Caffe::mode() == Caffe::CPU) << "INT8 mode only runs on the CPU.";
+  if ((options.fold_layers || options.int8) && !hdf5)
+  {
+    /* Fold BatchNorm and Scale into the convolutions before the net is
+     * built, so those layers never run. */
+    NetParameter model, weights;
+    ReadNetParamsFromTextFileOrDie(options.model_file, &model);
+    ReadNetParamsFromBinaryFileOrDie(trained_file, &weights);
+    model.mutable_state()->set_phase(TEST);
+    if (options.fold_layers)
+      FoldBatchNorm(&model, &weights);
+    if (options.int8)
+      UseInt8Layers(&model);
+
+    net_.reset(new Net<float>(model));
+    net_->CopyTrainedLayersFrom(weights);
+  }
+  else
+  {
+    net_.reset(new Net<float>(options.model_file, TEST));
+    net_->CopyTrainedLayersFrom(trained_file);
+  }
+
+  CHECK_EQ(net_->num_inputs(), 1) << "Network should have exactly one input.";
+  CHECK_EQ(net_->num_outputs(), 1) << "Network should have exactly one output.";
+
+  Blob<float>* input_layer = net_->input_blobs()[0];
+  num_channels_ = input_layer->channels();
+  input_geometry_ = cv::Size(input_layer->width(), input_layer->height());
+  num_outputs_ = net_->output_blobs()[0]->channels();
+
+  /* Shape the network for full batches once, so only a short batch at
+   * the end of a movie makes Forward reshape it. */
+  input_layer->Reshape(options.batch_size, num_channels_,
+                       input_geometry_.height, input_geometry_.width);
+  net_->Reshape();
+
+  /* The int8 layers share a pool of their own, the preprocessing one
+   * is busy with the next batch while Forward runs. */
+  for (int i = 0; i < net_->layers().size(); ++i)
+  {
+    Int8Layer* layer = dynamic_cast<Int8Layer*>(net_->layers()[i].get());
+    if (layer)
+    {
+      layer->set_thread_pool(&forward_pool_);
+      int8_layers_.push_back(layer);
+    }
+  }
+}
+
+/* Nothing is allocated here once the network has its shape: the input
+ * is the caller's buffer and the scores go straight to theirs. */
+void CaffeBackend::Forward(float* input, int num, float* scores)
+{
+  Blob<float>* input_layer = net_->input_blobs()[0];
+  if (input_layer->num() != num)
+  {
+    /* Blobs keep their capacity, so going back to a full batch after
+     * a short one doesn't reallocate either. */
+    input_layer->Reshape(num, num_channels_,
+                         input_geometry_.height, input_geometry_.width);
+    /* Forward dimension change to all layers. */
+    net_->Reshape();
+  }
+
+  /* Point the input layer at the staging buffer instead of copying it. */
+  input_layer->set_cpu_data(input);
+
+  net_->Forward();
+
+  Blob<float>* output_layer = net_->output_blobs()[0];
+  const float* output = output_layer->cpu_data();
+  std::copy(output, output + output_layer->count(), scores);
+}
+
+/* The int8 layers run in float while they record the range of their
+ * inputs, then they are quantized and switched on. */
+void CaffeBackend::BeginCalibration()
+{
+  for (int i = 0; i < int8_layers_.size(); ++i)
+    int8_layers_[i]->set_mode(Int8Layer::CALIBRATE);
+}
+
+void CaffeBackend::EndCalibration()
+{
+  for (int i = 0; i < int8_layers_.size(); ++i)
+  {
+    int8_layers_[i]->Quantize();
+    int8_layers_[i]->set_mode(Int8Layer::INT8);
+  }
+}
+
+void CaffeBackend::SetInt8(bool on)
+{
+  for (int i = 0; i < int8_layers_.size(); ++i)
+    int8_layers_[i]->set_mode(on ? Int8Layer::INT8 : Int8Layer::FLOAT);
+}
@@ -0,0 +1,45 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef CAFFE_BACKEND_HPP
+#define CAFFE_BACKEND_HPP
+
+#include <caffe/caffe.hpp>
+#include <vector>
+#include "inference_backend.hpp"
+#include "thread_pool.hpp"
+
+class Int8Layer;
+
+/* The network run by Caffe, on the GPU unless built with CPU_ONLY.
+ * BatchNorm is folded into the convolutions at load unless turned off,
+ * and with int8 set the convolutions can be quantized. */
+class CaffeBackend : public InferenceBackend
+{
+ public:
+  explicit CaffeBackend(const BackendOptions& options);
+
+  virtual const char* Name() const { return "caffe"; }
+
+  virtual cv::Size InputGeometry() const { return input_geometry_; }
+  virtual int NumChannels() const { return num_channels_; }
+  virtual int NumOutputs() const { return num_outputs_; }
+
+  virtual void Forward(float* input, int num, float* scores);
+
+  virtual bool HasInt8() const { return !int8_layers_.empty(); }
+  virtual void BeginCalibration();
+  virtual void EndCalibration();
+  virtual void SetInt8(bool on);
+
+ private:
+  boost::shared_ptr<caffe::Net<float> > net_;
+  cv::Size input_geometry_;
+  int num_channels_;
+  int num_outputs_;
+  ThreadPool forward_pool_;
+  std::vector<Int8Layer*> int8_layers_;
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Created by Ryan Jay 30.10.16
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <caffe/caffe.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "classifier.hpp"
+#include "preprocess.hpp"
+#include "stats.hpp"
+
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using namespace std;
+using std::string;
+
+
+Classifier::Classifier(const BackendOptions& backend,
+                       const string& mean_file,
+                       const string& label_file,
+                       int preprocess_threads)
+    : batch_size_(backend.batch_size),
+      pool_(preprocess_threads)
+{
+  /* Load the network. */
+  backend_ = CreateBackend(backend);
+
+  num_channels_ = backend_->NumChannels();
+  CHECK(num_channels_ == 3 || num_channels_ == 1)
+    << "Input layer should have 1 or 3 channels.";
+  input_geometry_ = backend_->InputGeometry();
+
+  /* Load the binaryproto mean file. */
+  SetMean(mean_file);
+
+  /* Load labels. */
+  std::ifstream labels(label_file.c_str());
+  CHECK(labels) << "Unable to open labels file " << label_file;
+  string line;
+  while (std::getline(labels, line))
+    labels_.push_back(string(line));
+
+  CHECK_EQ(labels_.size(), backend_->NumOutputs())
+    << "Number of labels is different from the output layer dimension.";
+}
+
+
+/* Return the all predictions, a batch at a time. */
+ScoreMatrix Classifier::Classify(const vector<cv::Mat>& imgs) 
+{
+  ScoreMatrix outputs(labels_.size());
+  outputs.Resize(imgs.size());
+  for (int i = 0; i < imgs.size(); i += batch_size_)
+  {
+    vector<cv::Mat> batch(imgs.begin() + i,
+                          imgs.begin() + min((int)imgs.size(), i + batch_size_));
+    Stage(batch, &staged_);
+    Predict(&staged_, outputs.row(i));
+  }
+  return outputs;
+}
+
+/* Let the backend pick its quantization ranges on these frames. */
+void Classifier::Calibrate(const vector<cv::Mat>& imgs)
+{
+  CHECK(backend_->HasInt8()) << "The classifier was not created for INT8.";
+  backend_->BeginCalibration();
+  Classify(imgs);
+  backend_->EndCalibration();
+}
+
+void Classifier::SetInt8(bool on)
+{
+  backend_->SetInt8(on);
+}
+
+void Classifier::Classify(StagedBatch* batch, float* scores) 
+{
+  Predict(batch, scores);
+}
+
+/* Preprocess a batch into a staging buffer. Doesn't touch the network
+ * so it is safe to run while Forward is busy with another batch. */
+void Classifier::Stage(const vector<cv::Mat>& imgs, StagedBatch* batch) 
+{
+  StageTimer timer("preprocess", imgs.size());
+  int sample_size = num_channels_ * input_geometry_.area();
+  if(batch->data.size() < imgs.size() * sample_size)
+    batch->data.resize(imgs.size() * sample_size);
+  batch->num = imgs.size();
+
+  /* Each worker writes the planes of its images straight into their
+   * slice of the buffer. */
+  float* input_data = batch->data.empty() ? NULL : &batch->data[0];
+  pool_.ParallelFor(imgs.size(), [this, &imgs, input_data](int i) {
+      Preprocess(imgs[i], input_data + i * num_channels_ * input_geometry_.area());
+  });
+}
+
+/* Load the mean file in binaryproto format. */
+void Classifier::SetMean(const string& mean_file) 
+{
+  BlobProto blob_proto;
+  ReadProtoFromBinaryFileOrDie(mean_file.c_str(), &blob_proto);
+
+  /* Convert from BlobProto to Blob<float> */
+  Blob<float> mean_blob;
+  mean_blob.FromProto(blob_proto);
+  CHECK_EQ(mean_blob.channels(), num_channels_)
+    << "Number of channels of mean file doesn't match input layer.";
+
+  /* The format of the mean file is planar 32-bit float BGR or grayscale. */
+  std::vector<cv::Mat> channels;
+  float* data = mean_blob.mutable_cpu_data();
+  for (int i = 0; i < num_channels_; ++i) 
+  {
+    /* Extract an individual channel. */
+    cv::Mat channel(mean_blob.height(), mean_blob.width(), CV_32FC1, data);
+    channels.push_back(channel);
+    data += mean_blob.height() * mean_blob.width();
+  }
+
+  /* Merge the separate channels into a single image. */
+  cv::Mat mean;
+  cv::merge(channels, mean);
+
+  /* Compute the global mean pixel value of each channel, it is
+   * subtracted from every pixel while packing the input. */
+  cv::Scalar channel_mean = cv::mean(mean);
+  mean_values_.clear();
+  for (int i = 0; i < num_channels_; ++i)
+    mean_values_.push_back(channel_mean[i]);
+}
+
+void Classifier::Predict(StagedBatch* batch, float* scores) 
+{
+  StageTimer timer("forward", batch->num);
+  backend_->Forward(&batch->data[0], batch->num, scores);
+}
+
+/* Convert a frame to the input format of the network and write it to
+ * input_data as planar float. The float conversion, mean subtraction
+ * and split into planes are fused in PackPlanarFloat, so the only
+ * intermediate images are the color conversion and the resize, and
+ * those reuse per thread buffers. It lives in PreprocessFrame so the
+ * benchmark times this same code. */
+void Classifier::Preprocess(const cv::Mat& img, float* input_data) 
+{
+  CHECK(PreprocessFrame(img, input_geometry_, num_channels_, &mean_values_[0], input_data))
+      << "Frames should be 8 bit.";
+}
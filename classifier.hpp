@@ -0,0 +1,72 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef CLASSIFIER_HPP
+#define CLASSIFIER_HPP
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include "cut_movie.hpp"
+#include "inference_backend.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+
+/* A batch that has been preprocessed into the planar float layout of
+ * the input layer and is waiting for its turn on the network. */
+struct StagedBatch
+{
+  StagedBatch() : num(0) {}
+
+  std::vector<float> data;
+  int num;
+};
+
+class Classifier 
+{
+ public:
+  Classifier(const BackendOptions& backend,
+             const string& mean_file,
+             const string& label_file,
+             int preprocess_threads = 1);
+
+  ScoreMatrix Classify(const vector<cv::Mat>& imgs);
+
+  /* With int8 set in the backend options, the network runs in float
+   * until it is calibrated on some frames. SetInt8 switches between the
+   * two afterwards, to compare them. */
+  void Calibrate(const vector<cv::Mat>& imgs);
+  void SetInt8(bool on);
+
+  /* Split in two so the next batch can be staged on another thread
+   * while the network works on the current one. The scores of the
+   * batch are written to scores, batch->num rows of labels_.size(). */
+  void Stage(const vector<cv::Mat>& imgs, StagedBatch* batch);
+  void Classify(StagedBatch* batch, float* scores);
+
+  /* Floats in one preprocessed frame. */
+  int InputSize() const { return num_channels_ * input_geometry_.area(); }
+
+  std::vector<string> labels_;
+
+ private:
+  void SetMean(const string& mean_file);
+
+  void Predict(StagedBatch* batch, float* scores);
+
+  void Preprocess(const cv::Mat& img, float* input_data);
+
+ private:
+  boost::shared_ptr<InferenceBackend> backend_;
+  int batch_size_;
+  cv::Size input_geometry_;
+  int num_channels_;
+  std::vector<float> mean_values_;
+  ThreadPool pool_;
+  StagedBatch staged_;
+};
+
+#endif
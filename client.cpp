@@ -0,0 +1,220 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Sends movies to a running "miles-deep -S" server instead of loading
+//the model for every run. Takes the same cutting options as miles-deep.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <climits>
+#include <unistd.h>
+
+#include "protocol.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+void PrintUsage(char* prog_name)
+{
+    cout << "Usage: " << prog_name << " [-S socket] [-t target|-x|-a|-r] [-o output_dir] [options] movie_file ..." << endl;
+    cout << endl;
+    cout << "-S\tSocket of the miles-deep server (default: " << kDefaultSocket << ")" << endl;
+    cout << "-t\tComma separated list of the Targets to search for (default:blowjob_handjob)" << endl;
+    cout << "-x\tRemove all non-sexual scenes. Same as all targets except \'other\'. Ignores -t." << endl;
+    cout << "-a\tCreate a tag file with the cuts for all categories. Ignores -t and -x" << endl; 
+    cout << "-r\tPrint the raw scores of every second as csv. Ignores -t, -x and -a" << endl; 
+    cout << "-o\tOutput directory (default: same as input)" << endl;
+    cout << "-u\tMinimum cUt in seconds (default: 4)" << endl;
+    cout << "-g\tMax Gap (default: 2)- the largest section of non-target frames in a cut" << endl;
+    cout << "-s\tMinimum Score (default: 0.5) - minimum value considered a match [0-1]" << endl;
+    cout << "-v\tMinimum coVerage of target frames in a cut (default: 0.4) [0-1]" << endl;
+    cout << "-c\tDon't Concatenate. Output cut directory (default: off)" << endl;
+    cout << "-e\tClassify Every n-th second first and refine where needed (default: 1 = off)" << endl;
+    cout << "-z\tReuse the scores of near identical frames below this difference (default: 0 = off). Not with -e" << endl;
+}
+
+vector<string> Split(const string &s, char delim) 
+{
+    stringstream ss(s);
+    string item;
+    vector<string> tokens;
+    while (getline(ss, item, delim)) 
+        tokens.push_back(item);
+    return tokens;
+}
+
+//the server has its own working directory
+string AbsolutePath(const string& path)
+{
+    char resolved[PATH_MAX];
+    if(realpath(path.c_str(), resolved) == NULL)
+        return path;
+    return string(resolved);
+}
+
+//send one movie and print what comes back, false on error
+bool RunJob(const string& socket_path, const JobRequest& request)
+{
+    int fd = ConnectSocket(socket_path);
+    if(fd < 0)
+    {
+        cerr << "Cannot connect to server at: " << socket_path << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    LineSocket sock(fd);
+    if(!WriteRequest(&sock, request))
+    {
+        cerr << "Error sending job for: " << request.movie_file << endl;
+        close(fd);
+        return false;
+    }
+
+    bool ok = false;
+    string line;
+    while(sock.ReadLine(&line))
+    {
+        stringstream ss(line);
+        string key;
+        ss >> key;
+
+        if(key == "ok")
+        {
+            ok = true;
+            break;
+        }
+        else if(key == "error")
+        {
+            cerr << "Error: " << line.substr(min(line.size(), (size_t)6)) << endl;
+            break;
+        }
+        else if(key == "labels" && request.mode == "scores")
+        {
+            string labels;
+            ss >> labels;
+            cout << "second," << labels << endl;
+        }
+        else if(key == "seconds" && request.mode != "scores")
+        {
+            int seconds;
+            ss >> seconds;
+            cout << "Classified: " << PrettyTime(seconds) << endl;
+        }
+        else if(key == "skipped" && request.mode != "scores")
+        {
+            int skipped;
+            ss >> skipped;
+            if(skipped > 0)
+                cout << "Reused scores: " << PrettyTime(skipped) << endl;
+        }
+        else if(key == "row")
+        {
+            string second, scores;
+            ss >> second >> scores;
+            cout << second << "," << scores << endl;
+        }
+        else if(key == "cut")
+        {
+            string label;
+            int s, e;
+            float score, coverage;
+            ss >> label >> s >> e >> score >> coverage;
+            if(label != "-")
+                cout << label << " ";
+            cout << PrettyTime(s) << " - " << PrettyTime(e) << ": size= " 
+                << PrettyTime(e - s + 1) << " coverage= " << coverage 
+                << " score= " << score << endl;
+        }
+    }
+
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    string socket_path = kDefaultSocket;
+    JobRequest request;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "S:t:xaro:u:g:s:v:cz:e:h")) != -1) 
+    {
+        switch (opt) {
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 't':
+            request.targets = Split(optarg, ',');
+            break;
+        case 'x':
+            request.all_but_other = true;
+            break;
+        case 'a':
+            if(request.mode != "scores")
+                request.mode = "tag";
+            break;
+        case 'r':
+            request.mode = "scores";
+            break;
+        case 'o':
+            request.output_dir = AbsolutePath(optarg);
+            break;
+        case 'u':
+            request.min_cut = atoi(optarg);
+            break;
+        case 'g':
+            request.max_gap = atoi(optarg);
+            break;
+        case 's':
+            request.min_score = atof(optarg);
+            break;
+        case 'v':
+            request.min_coverage = atof(optarg);
+            break;
+        case 'c':
+            request.do_concat = false;
+            break;
+        case 'e':
+            request.sample_stride = atoi(optarg);
+            break;
+        case 'z':
+            request.skip_threshold = atof(optarg);
+            break;
+        case 'h':
+            PrintUsage(argv[0]);
+            exit(0);
+        default: /* '?' */
+            PrintUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(request.skip_threshold > 0 && request.sample_stride > 1)
+    {
+        cerr << "Warning: -z is ignored with -e" << endl;
+        request.skip_threshold = 0;
+    }
+
+    if(optind >= argc)
+    {
+        cerr << "No input movie file." << endl;
+        PrintUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int failed = 0;
+    for(int i=optind; i < argc; i++)
+    {
+        request.movie_file = AbsolutePath(argv[i]);
+        if(argc - optind > 1 && request.mode != "scores")
+            cout << "Movie: " << request.movie_file << endl;
+        if(!RunJob(socket_path, request))
+            failed++;
+    }
+
+    return failed ? EXIT_FAILURE : 0;
+}
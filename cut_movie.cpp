@@ -9,93 +9,165 @@
 #include <stdlib.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <fstream>
 #include <string>
 
 #include "cut_movie.hpp"
+#include "remux.hpp"
+#include "stats.hpp"
+#include "tag_file.hpp"
 #include "util.hpp"
 
 using namespace std;
 
-//find the cuts using the winners and their values (returns the cut_list)
-int findTheCuts(int score_list_size, const vector<int>& winners,const vector<float>& vals, 
-        const vector<int>& target_on, string target, int min_cut, int max_gap, float threshold, float min_coverage,
-        CutList* cut_list)
+//ffmpeg processes cutting pieces at the same time. They only copy
+//streams, so more than a few just wait on the disk.
+const int kCutJobs = 4;
+
+//bytes of pieces in the temp directories of all the cutters
+static atomic<long long> temp_in_use(0);
+static atomic<long long> temp_peak(0);
+
+static void AddTempBytes(long long bytes)
 {
+    long long now = temp_in_use += bytes;
+    long long peak = temp_peak;
+    while(now > peak && !temp_peak.compare_exchange_weak(peak, now))
+        ;
+}
 
-    int cut_start = -1;
-    int gap = 0;
-    int win_sum = 0;
-    float val_sum = 0.0;
-    int total_size = 0;
+long long PeakTempBytes()
+{
+    return temp_peak;
+}
 
-    for( int i=0; i<score_list_size; i++)
+CutDetector::CutDetector(const vector<int>& target_on, const string& target, int min_cut, 
+        int max_gap, float threshold, float min_coverage)
+    : target_on_(target_on), target_(target), min_cut_(min_cut), max_gap_(max_gap),
+      threshold_(threshold), min_coverage_(min_coverage), has_pending_(false),
+      pending_winner_(0), pending_val_(0), second_(0), cut_start_(-1), gap_(0), 
+      win_sum_(0), val_sum_(0.0), total_size_(0)
+{
+}
+
+bool CutDetector::Add(int winner, float val, Cut* cut)
+{
+    bool closed = false;
+    if(has_pending_)
+        closed = Step(pending_winner_, pending_val_, false, cut);
+    has_pending_ = true;
+    pending_winner_ = winner;
+    pending_val_ = val;
+    return closed;
+}
+
+bool CutDetector::Finish(Cut* cut)
+{
+    if(!has_pending_)
+        return false;
+    has_pending_ = false;
+    return Step(pending_winner_, pending_val_, true, cut);
+}
+
+bool CutDetector::Step(int winner, float val, bool last, Cut* cut)
+{
+    int i = second_++;
+    bool closed = false;
+
+    if( cut_start_ >= 0 )
     {
-        if( cut_start >= 0 )
+        if( target_on_[winner] )
         {
-            if( target_on[winners[i]] )
-            {
-                win_sum++;
-                val_sum += vals[i];
-            }
-            
-            if( !target_on[winners[i]] || vals[i] < threshold || i == score_list_size-1 )
-            {
-                if(i < score_list_size-1) gap++;
+            win_sum_++;
+            val_sum_ += val;
+        }
+        
+        if( !target_on_[winner] || val < threshold_ || last )
+        {
+            if(!last) gap_++;
 
-                if( gap > max_gap || i == score_list_size-1 )
+            if( gap_ > max_gap_ || last )
+            {
+                if( cut_start_ < i - gap_ - min_cut_ )
                 {
-                    if( cut_start < i - gap - min_cut )
+                    //output cut
+                    int win_size = (i - gap_) - cut_start_ + 1;
+                    float score_avg = val_sum_ / (float)win_sum_;
+                    float coverage = (float)win_sum_ / (float)win_size;
+
+                    if(coverage >= min_coverage_)
                     {
-                        //output cut
-                        int win_size = (i - gap) - cut_start + 1;
-                        float score_avg = val_sum / (float)win_sum;
-                        float coverage = (float)win_sum / (float)win_size;
-
-                        if(coverage >= min_coverage)
-                        {
-                            cout << PrettyTime(cut_start) << " - " << PrettyTime(i - gap)
-                                << ": size= " << PrettyTime(win_size) << " coverage= " << coverage 
-                                << " score= " << score_avg << '\n';
-                            total_size += win_size;
-                            Cut cut;
-                            cut.s = cut_start;
-                            cut.e = i-gap;
-                            cut.score = score_avg;
-                            cut.coverage = coverage;
-                            cut.label = target;
-                            cut_list->push_back(cut);
-                        }
+                        total_size_ += win_size;
+                        cut->s = cut_start_;
+                        cut->e = i - gap_;
+                        cut->score = score_avg;
+                        cut->coverage = coverage;
+                        cut->label = target_;
+                        closed = true;
                     }
-                    cut_start = -1;
-                    gap = 0;
-                    val_sum = 0.0;
-                    win_sum = 0;
                 }
+                cut_start_ = -1;
+                gap_ = 0;
+                val_sum_ = 0.0;
+                win_sum_ = 0;
             }
-            else
-            {
-                gap = 0;
-            }
-
         }
-        else if( target_on[winners[i]] && vals[i] >= threshold )
+        else
         {
-            cut_start = i;
-            gap = 0;
-            val_sum = 0.0;
-            win_sum = 0.0;
+            gap_ = 0;
         }
+
+    }
+    else if( target_on_[winner] && val >= threshold_ )
+    {
+        cut_start_ = i;
+        gap_ = 0;
+        val_sum_ = 0.0;
+        win_sum_ = 0;
     }
 
-    return(total_size);
+    return closed;
+}
 
+static void printCut(const Cut& cut)
+{
+    int win_size = cut.e - cut.s + 1;
+    cout << PrettyTime(cut.s) << " - " << PrettyTime(cut.e)
+        << ": size= " << PrettyTime(win_size) << " coverage= " << cut.coverage 
+        << " score= " << cut.score << '\n';
 }
 
+//find the cuts using the winners and their values (returns the cut_list)
+int findTheCuts(int score_list_size, const vector<int>& winners,const vector<float>& vals, 
+        const vector<int>& target_on, string target, int min_cut, int max_gap, float threshold, float min_coverage,
+        CutList* cut_list)
+{
+    StageTimer timer("find_cuts", score_list_size);
+    CutDetector detector(target_on, target, min_cut, max_gap, threshold, min_coverage);
+    Cut cut;
+    for( int i=0; i<score_list_size; i++)
+    {
+        if(detector.Add(winners[i], vals[i], &cut))
+        {
+            printCut(cut);
+            cut_list->push_back(cut);
+        }
+    }
+    if(detector.Finish(&cut))
+    {
+        printCut(cut);
+        cut_list->push_back(cut);
+    }
+
+    return detector.Total();
+}
 
-void TagTargets( ScoreList score_list, string movie_file, string output_dir, 
+
+bool TagTargets( const ScoreMatrix& score_list, string movie_file, string output_dir, 
         vector<string> labels, int total_targets, int min_cut, int max_gap, 
-        float threshold, float min_coverage)
+        float threshold, float min_coverage, CutList* cuts, string* error)
 {
     //path stuff with movie file
     char  sep = '/';
@@ -108,29 +180,14 @@ void TagTargets( ScoreList score_list, string movie_file, string output_dir,
     if(output_dir == "")
         output_dir = movie_directory;
     string tag_path = output_dir + sep + tag_movie;
+    string binary_tag_path = tag_path + "b";
 
     //find winners and their scores
-    vector<int> winners(score_list.size());
-    vector<float> vals(score_list.size());
-    for( int i=0; i < score_list.size(); i++ )
-    {
-        winners[i] = scoreArgMax(score_list[i]);
-        vals[i] = scoreMax(score_list[i]);
-    }
-
-    //open tag output file
-    ofstream f(tag_path);
-    if(!f)
-    {
-        cerr << "Cannot open file: " << tag_path << endl;
-        exit(EXIT_FAILURE);
-    }
-
-    //write header
-    f << getFileName(movie_file) << ",";
-    for(int i=0; i < labels.size(); i++)
-         f << labels[i] << ",";
-    f << endl;
+    vector<int> winners(score_list.rows());
+    vector<float> vals(score_list.rows());
+    if( score_list.rows() > 0 )
+        scoreArgMaxRows(score_list.data(), score_list.rows(), score_list.cols(),
+                &winners[0], &vals[0]);
 
     //find the predicted cuts for each target
     vector<int> target_time(total_targets,0);
@@ -143,7 +200,7 @@ void TagTargets( ScoreList score_list, string movie_file, string output_dir,
 
         cout << "Target [" << labels[i] << "]" << endl;
 
-        target_time[i] = findTheCuts(score_list.size(), winners, vals, target_on, labels[i], min_cut, 
+        target_time[i] = findTheCuts(score_list.rows(), winners, vals, target_on, labels[i], min_cut, 
             max_gap, threshold, min_coverage, &cut_list);
 
 
@@ -152,193 +209,463 @@ void TagTargets( ScoreList score_list, string movie_file, string output_dir,
 
     }
 
-    //write target total information
-    f << score_list.size() << ",";
-    for(int i=0; i< total_targets; i++)
-        f << target_time[i] << ",";
-    f << endl;
-
     //sort the list based on cut start time
     sort(cut_list.begin(),cut_list.end(), [](const Cut &x, const Cut &y){ return (x.s < y.s);});
 
 
-    //write cutlist to tag file
-    f << "label,start,end,score,coverage" << endl;
-    for( int j=0; j<cut_list.size(); j++)
+    //write the cutlist and totals to the tag file, and the same
+    //with all the scores to the binary one
+    TagData tags;
+    tags.movie = getFileName(movie_file);
+    tags.labels = labels;
+    tags.seconds = score_list.rows();
+    tags.scores = score_list;
+    tags.cuts = cut_list;
+    *cuts = cut_list;
+
+    cout << "Writing tag data to: " << tag_path << endl; 
+    StageTimer timer("write_tags");
+    if(!WriteTagCsv(tag_path, tags) || !WriteTagBinary(binary_tag_path, tags))
     {
-        Cut this_cut = cut_list[j];
-        f << this_cut.label << "," << this_cut.s << "," << this_cut.e 
-            << "," << this_cut.score << "," << this_cut.coverage << endl;
+        *error = "cannot write file: " + tag_path;
+        return false;
     }
 
-    cout << "Writing tag data to: " << tag_path << endl; 
-    f.close();
+    return true;
+}
+
+
+PieceCutter::PieceCutter(const string& movie_file, const string& temp_dir)
+    : movie_file_(movie_file), temp_dir_(temp_dir), output_seek_(false), max_temp_(0),
+      spilled_(0), temp_bytes_(0), done_bytes_(0), done_seconds_(0), movie_rate_(0)
+{
+    cut_movie_ = getBaseName(getFileName(movie_file)) + ".cut";
+    movie_type_ = getFileExtension(movie_file);
 
+    //use output_seek for wmv. fixed bug where cuts would freeze
+    if(movie_type_ == ".wmv" || movie_type_ == ".WMV" || movie_type_ == ".Wmv")
+    {
+        output_seek_ = true;
+        movie_type_ = ".mkv";
+    }
 }
 
+void PieceCutter::LimitTemp(long long max_bytes, const string& output_dir, bool do_concat,
+        int movie_seconds)
+{
+    char  sep = '/';
+    #ifdef _WIN32
+    char  sep = '\\';
+    #endif
+
+    max_temp_ = max_bytes;
+    spill_dir_ = output_dir + sep + cut_movie_ + (do_concat ? ".parts" : "");
+    long long movie_bytes = fileSize(movie_file_);
+    if(movie_seconds > 0 && movie_bytes > 0)
+        movie_rate_ = (double)movie_bytes / movie_seconds;
+}
 
-void CutMovie( ScoreList score_list, string movie_file, vector<int> target_list, 
-        string output_dir, string temp_dir, int total_targets, int min_cut, int max_gap, 
-        float threshold, float min_coverage, bool do_concat, bool remove_original)
+void PieceCutter::WaitOldest()
 {
+    pair<pid_t, int> oldest = running_.front();
+    running_.pop_front();
+    if(waitProcess(oldest.first) != 0)
+    {
+        failed_.push_back(oldest.second);
+        return;
+    }
 
-    //path stuff with movie file
+    long long size = max(0LL, fileSize(part_names_[oldest.second]));
+    temp_bytes_ += size;
+    done_bytes_ += size;
+    done_seconds_ += part_seconds_[oldest.second];
+    AddTempBytes(size);
+}
+
+//wait for the pieces being cut and move all of them out of the temp directory
+void PieceCutter::Spill()
+{
     char  sep = '/';
     #ifdef _WIN32
     char  sep = '\\';
     #endif
-    string movie_base = getBaseName(getFileName(movie_file));
-    string movie_type = getFileExtension(movie_file);
-    string cut_movie = movie_base + ".cut";
-    string temp_base = temp_dir + sep + "cuts";
-    string temp_path = temp_base + sep + cut_movie;
-    string movie_directory = getDirectory(movie_file);
 
-    //will come from input
-    vector<int> target_on(total_targets,0);
-    for(int i=0; i<target_list.size(); i++)
-       target_on[target_list[i]] = 1; 
+    while(!running_.empty())
+        WaitOldest();
+    if(spilled_ == part_names_.size() || !failed_.empty() || error_ != "")
+        return;
 
+    StageTimer timer("spill", part_names_.size() - spilled_);
+    if(spilled_ == 0)
+    {
+        //the concat list is read from the temp directory, so the
+        //pieces need a full path
+        string mkdir_cmd = "mkdir -p \"" + spill_dir_ + "\"";
+        char* full_path = system(mkdir_cmd.c_str()) ? NULL : realpath(spill_dir_.c_str(), NULL);
+        if(full_path == NULL)
+        {
+            error_ = "cannot make directory for the pieces: " + spill_dir_;
+            return;
+        }
+        spill_dir_ = full_path;
+        free(full_path);
+    }
 
+    vector<string> mv_command = {"mv"};
+    for(int i=spilled_; i<part_names_.size(); i++)
+        mv_command.push_back(part_names_[i]);
+    mv_command.push_back(spill_dir_);
+    pid_t pid = startProcess(mv_command);
+    if(pid < 0 || waitProcess(pid) != 0)
+    {
+        error_ = "cannot move the pieces to: " + spill_dir_;
+        return;
+    }
+
+    for(int i=spilled_; i<part_names_.size(); i++)
+        part_names_[i] = spill_dir_ + sep + getFileName(part_names_[i]);
+    spilled_ = part_names_.size();
+    AddTempBytes(-temp_bytes_);
+    temp_bytes_ = 0;
+}
 
-    string mkdir_command = "mkdir -p " + temp_base;
-    if(system(mkdir_command.c_str()))
+void PieceCutter::Add(const Cut& cut)
+{
+    char  sep = '/';
+    #ifdef _WIN32
+    char  sep = '\\';
+    #endif
+
+    //nothing more is cut once something went wrong, Finish reports it
+    if(error_ != "")
+        return;
+
+    //pieces go in a directory of their own so several movies
+    //can be cut at the same time
+    if(temp_base_ == "")
     {
-        cerr << "Error making directory: " << temp_base << endl;
-        exit(EXIT_FAILURE);
+        temp_base_ = makeTempDirectory(temp_dir_, "cuts");
+        if(temp_base_ == "")
+        {
+            error_ = "cannot make directory in: " + temp_dir_;
+            return;
+        }
     }
-    
-    //init
-    CutList cut_list;
-    bool did_concat = true;
 
+    //room for the pieces being cut and this one, at the rate of the
+    //ones done so far
+    if(max_temp_ > 0)
+    {
+        int seconds = cut.e - cut.s;
+        for(int j=0; j<running_.size(); j++)
+            seconds += part_seconds_[running_[j].second];
+        double rate = done_seconds_ > 0 ? (double)done_bytes_ / done_seconds_ : movie_rate_;
+        if(temp_bytes_ + rate * seconds > max_temp_)
+            Spill();
+        if(error_ != "")
+            return;
+    }
 
-    //find winners and their scores
-    vector<int> winners(score_list.size());
-    vector<float> vals(score_list.size());
+    //a few at a time, waited for oldest first
+    if(running_.size() == kCutJobs)
+        WaitOldest();
+
+    int i = part_names_.size();
+    string part_name = temp_base_ + sep + cut_movie_ + '.' + to_string(i) + movie_type_;
+    part_names_.push_back(part_name);
+    part_seconds_.push_back(cut.e - cut.s);
+    cout << "   Creating piece: " << part_name << endl;
+
+    vector<string> cut_command;
+    if(output_seek_)
+        cut_command = {"ffmpeg", "-nostdin", "-loglevel", "8", "-y", "-i", movie_file_,
+            "-ss", to_string(cut.s), "-t", to_string(cut.e - cut.s),
+            "-c", "copy", part_name};
+    else       
+        cut_command = {"ffmpeg", "-nostdin", "-loglevel", "8", "-y",
+            "-ss", to_string(cut.s), "-i", movie_file_,
+            "-t", to_string(cut.e - cut.s),
+            "-c", "copy", "-avoid_negative_ts", "1", part_name};
+
+    pid_t pid = startProcess(cut_command);
+    if(pid < 0)
+        failed_.push_back(i);
+    else
+        running_.push_back(make_pair(pid, i));
+}
+
+//a path quoted for ffmpeg's concat list, where a ' inside quotes
+//is written as '\''
+static string concatQuote(const string& path)
+{
+    string quoted = "'";
+    for(int i=0; i<path.size(); i++)
+        if(path[i] == '\'')
+            quoted += "'\\''";
+        else
+            quoted += path[i];
+    return quoted + "'";
+}
+
+bool PieceCutter::Finish(const string& output_dir, bool do_concat, string* error)
+{
+    char  sep = '/';
+    #ifdef _WIN32
+    char  sep = '\\';
+    #endif
 
-    for( int i=0; i < score_list.size(); i++ )
     {
-        winners[i] = scoreArgMax(score_list[i]);
-        vals[i] = scoreMax(score_list[i]);
+        StageTimer timer("cut_wait");
+        while(!running_.empty())
+            WaitOldest();
     }
 
-    int total = findTheCuts(score_list.size(), winners, vals, target_on, 
-            "", min_cut, max_gap, threshold, min_coverage, &cut_list);
-    cout << "Total cut length: " << PrettyTime(total) << endl;
-    //make the cuts
-    if( cut_list.size() > 0 )
+    if(part_names_.empty() && error_ == "")
+        return true;
+
+    if(!failed_.empty() && error_ == "")
+    {
+        sort(failed_.begin(), failed_.end());
+        for(int j=0; j<failed_.size(); j++)
+            cerr << "Error cutting piece : " << part_names_[failed_[j]] << endl;
+        error_ = "cannot cut piece: " + part_names_[failed_[0]];
+    }
+
+    //write the pieces to cuts.txt in order as instructions for concatenation
+    string part_file_path = temp_base_ + ".txt";
+    if(error_ == "")
     {
-        cout << "Making the cuts" << endl;
-        string part_file_path = temp_dir + sep + "cuts.txt";
         ofstream part_file;
         part_file.open(part_file_path.c_str());
         if(!part_file.is_open())
-        {
-            cout << "Cannot open file for writing: " << part_file_path << endl;
-            exit(EXIT_FAILURE);
-        }
+            error_ = "cannot open file for writing: " + part_file_path;
+        for( int i=0; i<part_names_.size() && error_ == ""; i++)
+            part_file << "file " << concatQuote(part_names_[i]) << '\n';
+        part_file.close();
+    }
 
-        
-        //use output_seek for wmv. fixed bug where cuts would freeze
-        bool output_seek = false;
-        if(movie_type == ".wmv" || movie_type == ".WMV" || movie_type == ".Wmv")
+    if(error_ != "")
+    {
+        //nothing to output, just clean up below
+    }
+    else if(do_concat)
+    {
+        cout << "Concatenating parts in " << part_file_path << endl;
+        cout << "Final output: " << output_dir << sep << cut_movie_ << movie_type_ << endl;
+    
+        StageTimer timer("concat", part_names_.size());
+        vector<string> concat_command = {"ffmpeg", "-nostdin", "-loglevel", "16",
+            "-f", "concat", "-safe", "0", "-i", part_file_path,
+            "-c", "copy", output_dir + sep + cut_movie_ + movie_type_};
+        pid_t pid = startProcess(concat_command);
+        if(pid < 0 || waitProcess(pid) != 0)
+            error_ = "didn't concatenate pieces from: " + part_file_path;
+    }
+    else if(spilled_ > 0)
+    {
+        //some pieces are in the cut directory already, the rest join them
+        Spill();
+        if(error_ == "")
+            cout << "Final cut directory: " << spill_dir_ << endl;
+    }
+    else
+    {
+        //copy cut directory to output_dir instead of concatenating
+        cout << "Final cut directory: " << output_dir << sep << cut_movie_ << endl;
+        string copy_directory_cmd = "cp -r " + temp_base_ + sep + " \"" + 
+            output_dir + sep + cut_movie_ + "\"";
+        if(system(copy_directory_cmd.c_str()))
+            error_ = "can't copy cut directory to: " + output_dir + sep + cut_movie_;
+    }
+
+    //clean up cuts directory and cuts.txt file, and the pieces moved
+    //out of it if they were joined. Also after an error.
+    AddTempBytes(-temp_bytes_);
+    temp_bytes_ = 0;
+    if(temp_base_ != "")
+    {
+        string clean_cmd = "rm -rf " + part_file_path + " " + temp_base_;
+        if(do_concat && spilled_ > 0)
+            clean_cmd += " \"" + spill_dir_ + "\"";
+        if(system(clean_cmd.c_str()) && error_ == "")
+            error_ = "error cleaning up temporary cut piece files in: " + clean_cmd;
+    }
+
+    if(error_ != "")
+    {
+        *error = error_;
+        return false;
+    }
+    return true;
+}
+
+
+//flags for the labels in target_list
+static vector<int> targetsOn(const vector<int>& target_list, int total_targets)
+{
+    vector<int> target_on(total_targets,0);
+    for(int i=0; i<target_list.size(); i++)
+       target_on[target_list[i]] = 1; 
+    return target_on;
+}
+
+//ask about removing original and only keeping cut
+static bool removeOriginal(const string& movie_file, string* error)
+{
+    if(queryYesNo())
+    {
+        string rm_cmd = "rm -rf \"" + movie_file + "\"";
+        if(system(rm_cmd.c_str()))
         {
-            output_seek = true;
-            movie_type = ".mkv";
+            *error = "error removing input movie: " + rm_cmd;
+            return false;
         }
+    } 
+    return true;
+}
 
 
-        //output a file for each cut in the list
-        for( int i=0; i<cut_list.size(); i++)
-        {
+bool CutMovie( const ScoreMatrix& score_list, string movie_file, vector<int> target_list, 
+        string output_dir, string temp_dir, int total_targets, int min_cut, int max_gap, 
+        float threshold, float min_coverage, bool do_concat, bool remove_original,
+        long long max_temp, CutList* cuts, string* error)
+{
+
+    //path stuff with movie file
+    char  sep = '/';
+    #ifdef _WIN32
+    char  sep = '\\';
+    #endif
+    string movie_directory = getDirectory(movie_file);
+
+    //will come from input
+    vector<int> target_on = targetsOn(target_list, total_targets);
+
     
-            Cut this_cut = cut_list[i];
-
-            string part_name = temp_path + '.' + to_string(i) + movie_type;
-            cout << "   Creating piece: " << part_name << endl;
-
-            string cut_command;
-            if(output_seek)
-                cut_command = "ffmpeg -loglevel 8 -y -i \"" + movie_file + "\" -ss " + 
-                    to_string(this_cut.s) + " -t " + to_string(this_cut.e - this_cut.s)  +
-                    " -c copy \"" + part_name + "\"";
-            else       
-                cut_command = "ffmpeg -loglevel 8 -y -ss " + to_string(this_cut.s) +
-                    " -i \"" + movie_file + "\" -t " + to_string(this_cut.e - this_cut.s)  +
-                    " -c copy -avoid_negative_ts 1 \"" + part_name + "\"";
-
-            if(system(cut_command.c_str()))
-            {
-                cerr << "Error cutting piece : " << part_name << endl;
-                exit(EXIT_FAILURE);
-            }
+    //init
+    CutList& cut_list = *cuts;
+    cut_list.clear();
+    PieceCutter cutter(movie_file, temp_dir);
 
-            //write piece to cuts.txt as instructions for concatenation
-            part_file << "file \'" << part_name << "\'" << endl;
-        }
-        part_file.close();
+
+    //find winners and their scores
+    vector<int> winners(score_list.rows());
+    vector<float> vals(score_list.rows());
+    if( score_list.rows() > 0 )
+        scoreArgMaxRows(score_list.data(), score_list.rows(), score_list.cols(),
+                &winners[0], &vals[0]);
+
+    int total = findTheCuts(score_list.rows(), winners, vals, target_on, 
+            "", min_cut, max_gap, threshold, min_coverage, &cut_list);
+    cout << "Total cut length: " << PrettyTime(total) << endl;
+    //make the cuts
+    if( cut_list.size() > 0 )
+    {
+        cout << "Making the cuts" << endl;
 
         //default behavior (output cut where input movie is located)
         if(output_dir == "")
             output_dir = movie_directory;
+        string final_path = output_dir + sep + cutter.CutName() + cutter.MovieType();
 
-
+        bool remuxed = false;
+        #ifdef USE_LIBAV
+        //copy the packets of the cuts straight into the final movie,
+        //reading the input once and without any pieces on disk
         if(do_concat)
         {
-            cout << "Concatenating parts in " << part_file_path << endl;
-            cout << "Final output: " << output_dir << sep << cut_movie << movie_type << endl;
-        
-            string concat_command = "ffmpeg -loglevel 16 -f concat -safe 0 -i " + part_file_path + 
-                " -c copy \"" + output_dir + sep + cut_movie + movie_type + "\"";
-            if(system(concat_command.c_str()))
-            {
-                cerr << "Didn't concatenate pieces from: " << part_file_path << endl;
-                did_concat = false;
-            }
+            cout << "Final output: " << final_path << endl;
+            string remux_error;
+            StageTimer timer("remux", cut_list.size());
+            remuxed = RemuxCuts(movie_file, final_path, cut_list, &remux_error);
+            if(!remuxed)
+                cerr << "Couldn't remux the cuts (" << remux_error << "), using ffmpeg" << endl;
         }
-        else
+        #endif
+
+        if(!remuxed)
         {
-            //copy cut directory to output_dir instead of concatenating
-            cout << "Final cut directory: " << output_dir << sep << cut_movie << endl;
-            string copy_directory_cmd = "cp -r " + temp_dir + sep + "cuts/ \"" + 
-                output_dir + sep + cut_movie + "\"";
-            if(system(copy_directory_cmd.c_str()))
-            {
-                cerr << "Can't copy cut directory to: " 
-                    << output_dir << sep << cut_movie << endl;
-                //dont exit so we still clear cut directory
-                did_concat = false;
-            }
+            if(max_temp > 0)
+                cutter.LimitTemp(max_temp, output_dir, do_concat, score_list.rows());
+            StageTimer timer("cut_pieces", cut_list.size());
+            for( int i=0; i<cut_list.size(); i++)
+                cutter.Add(cut_list[i]);
+            if(!cutter.Finish(output_dir, do_concat, error))
+                return false;
         }
-
     }
     else
     {
         cout << "No cuts found." << endl;
-        return;
+        return true;
     }
 
     
-    //ask about removing original and only keeping cut
-    if(remove_original && did_concat && queryYesNo())
-    {
-        string rm_cmd = "rm -rf \"" + movie_file + "\"";
-        if(system(rm_cmd.c_str()))
-        {
-            cerr << "Error removing input movie: " << rm_cmd << endl;
-            exit(EXIT_FAILURE);
-        }
-    } 
+    if(remove_original)
+        return removeOriginal(movie_file, error);
+
+    return true;
+}
 
 
-    //clean up cuts directory and cuts.txt file
-    string clean_cmd = "rm -rf " + temp_dir + sep + "cuts.txt " + temp_base;
-    if(system(clean_cmd.c_str()))
+StreamingCut::StreamingCut(const string& movie_file, const vector<int>& target_list, 
+        const string& output_dir, const string& temp_dir, int total_targets, 
+        int min_cut, int max_gap, float threshold, float min_coverage, 
+        bool do_concat, bool remove_original, long long max_temp, int movie_seconds)
+    : movie_file_(movie_file), output_dir_(output_dir), total_targets_(total_targets),
+      do_concat_(do_concat), remove_original_(remove_original),
+      detector_(targetsOn(target_list, total_targets), "", min_cut, max_gap, threshold, 
+              min_coverage),
+      cutter_(movie_file, temp_dir)
+{
+    //default behavior (output cut where input movie is located)
+    if(output_dir_ == "")
+        output_dir_ = getDirectory(movie_file);
+    if(max_temp > 0)
+        cutter_.LimitTemp(max_temp, output_dir_, do_concat, movie_seconds);
+}
+
+void StreamingCut::AddRows(const float* rows, int n)
+{
+    if(n <= 0)
+        return;
+
+    vector<int> winners(n);
+    vector<float> vals(n);
+    scoreArgMaxRows(rows, n, total_targets_, &winners[0], &vals[0]);
+
+    Cut cut;
+    for(int i=0; i<n; i++)
+        if(detector_.Add(winners[i], vals[i], &cut))
+            AddCut(cut);
+}
+
+void StreamingCut::AddCut(const Cut& cut)
+{
+    if(cut_list_.empty())
+        cout << "Making the cuts" << endl;
+    printCut(cut);
+    cut_list_.push_back(cut);
+    cutter_.Add(cut);
+}
+
+bool StreamingCut::Finish(string* error)
+{
+    Cut cut;
+    if(detector_.Finish(&cut))
+        AddCut(cut);
+
+    cout << "Total cut length: " << PrettyTime(detector_.Total()) << endl;
+    if(cut_list_.empty())
     {
-        cerr << "Error cleaning up temporary cut piece files in: " 
-                << clean_cmd << endl; 
-        exit(EXIT_FAILURE);
+        cout << "No cuts found." << endl;
+        return true;
     }
+
+    if(!cutter_.Finish(output_dir_, do_concat_, error))
+        return false;
+    if(remove_original_)
+        return removeOriginal(movie_file_, error);
+    return true;
 }
 
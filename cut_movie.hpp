@@ -8,8 +8,10 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <vector>
 #include <string>
+#include <sys/types.h>
 
 using namespace std;
 
@@ -21,17 +23,195 @@ typedef struct {
     string label;
 } Cut;
 
-typedef vector<vector<float> > ScoreList;
+//the scores of every second of a movie, one row of labels per second,
+//stored row-major in one block. row() is a view into it, not a copy.
+class ScoreMatrix
+{
+ public:
+    explicit ScoreMatrix(int cols = 0) : rows_(0), cols_(cols) {}
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+
+    const float* row(int i) const { return &data_[(size_t)i * cols_]; }
+    float* row(int i) { return &data_[(size_t)i * cols_]; }
+    const float* data() const { return data_.empty() ? NULL : &data_[0]; }
+
+    void Reserve(int rows) { data_.reserve((size_t)rows * cols_); }
+
+    void Resize(int rows)
+    {
+        rows_ = rows;
+        data_.resize((size_t)rows * cols_);
+    }
+
+    void AppendRows(const float* rows, int n)
+    {
+        data_.insert(data_.end(), rows, rows + (size_t)n * cols_);
+        rows_ += n;
+    }
+
+ private:
+    int rows_;
+    int cols_;
+    vector<float> data_;
+};
+
 typedef vector<Cut> CutList;
 
+//Finds the cuts of one set of targets a second at a time, so they can be
+//used as soon as they close instead of after the whole movie is scored.
+//A cut is known max_gap + 1 seconds after it ends (one more at the end
+//of the movie).
+class CutDetector
+{
+ public:
+    CutDetector(const vector<int>& target_on, const string& target, int min_cut, 
+            int max_gap, float threshold, float min_coverage);
+
+    //the winner and its score for the next second, true if that closed a cut
+    bool Add(int winner, float val, Cut* cut);
+
+    //the movie ended, true if that closed the last cut
+    bool Finish(Cut* cut);
+
+    //seconds in all the cuts so far
+    int Total() const { return total_size_; }
+
+ private:
+    bool Step(int winner, float val, bool last, Cut* cut);
+
+    vector<int> target_on_;
+    string target_;
+    int min_cut_;
+    int max_gap_;
+    float threshold_;
+    float min_coverage_;
+
+    //a second is held back until the next one shows it wasn't the last
+    bool has_pending_;
+    int pending_winner_;
+    float pending_val_;
+
+    int second_;
+    int cut_start_;
+    int gap_;
+    int win_sum_;
+    float val_sum_;
+    int total_size_;
+};
+
+//Cuts pieces of a movie into the temp directory with ffmpeg, a few at a
+//time, then joins them or copies the directory of pieces to the output.
+class PieceCutter
+{
+ public:
+    PieceCutter(const string& movie_file, const string& temp_dir);
+
+    //Keep the pieces in the temp directory under max_bytes: when the next
+    //one could go over, the finished ones are moved next to the output
+    //first (into the cut directory with do_concat off). The size of the
+    //pieces is guessed from movie_seconds until some are done.
+    void LimitTemp(long long max_bytes, const string& output_dir, bool do_concat,
+            int movie_seconds);
+
+    //start cutting this piece, waits if too many are being cut
+    void Add(const Cut& cut);
+
+    //wait for all the pieces, then concatenate them (or copy them with
+    //do_concat off) to output_dir and clean up. False with the reason in
+    //error if any of that failed.
+    bool Finish(const string& output_dir, bool do_concat, string* error);
+
+    int Pieces() const { return part_names_.size(); }
+
+    //name and extension of the output
+    string CutName() const { return cut_movie_; }
+    string MovieType() const { return movie_type_; }
+
+ private:
+    void WaitOldest();
+    void Spill();
+
+    string movie_file_;
+    string temp_dir_;
+    string temp_base_;
+    string cut_movie_;
+    string movie_type_;
+    bool output_seek_;
+    vector<string> part_names_;
+    vector<int> part_seconds_;
+    deque<pair<pid_t, int> > running_;   //ffmpeg pid, piece
+    vector<int> failed_;
+    string error_;              //the first thing that went wrong
+
+    long long max_temp_;
+    string spill_dir_;
+    int spilled_;               //pieces before this one were moved to spill_dir_
+    long long temp_bytes_;      //of the finished pieces still in the temp directory
+    long long done_bytes_;
+    int done_seconds_;
+    double movie_rate_;         //bytes per second of the whole movie
+};
+
+//the most bytes that were in the pieces in the temp directory at once,
+//over every movie cut so far
+long long PeakTempBytes();
+
+//Cut a movie while it is being classified: pieces are started as soon as
+//the detector closes them, and joined once the movie is done. Same
+//arguments as CutMovie, plus the length of the movie if it is known.
+class StreamingCut
+{
+ public:
+    StreamingCut(const string& movie_file, const vector<int>& target_list, 
+            const string& output_dir, const string& temp_dir, int total_targets, 
+            int min_cut, int max_gap, float threshold, float min_coverage, 
+            bool do_concat, bool remove_original, long long max_temp = 0, 
+            int movie_seconds = -1);
+
+    //the scores of the next n seconds, n rows of total_targets
+    void AddRows(const float* rows, int n);
+
+    //the movie is done, finish the output. False with the reason in
+    //error if that failed.
+    bool Finish(string* error);
+
+ private:
+    void AddCut(const Cut& cut);
+
+    string movie_file_;
+    string output_dir_;
+    int total_targets_;
+    bool do_concat_;
+    bool remove_original_;
+    CutDetector detector_;
+    PieceCutter cutter_;
+    CutList cut_list_;
+};
+
+
+//find the cuts of the targets flagged in target_on, given the winning label
+//of every second and its score. Adds them to cut_list and returns their
+//total length.
+int findTheCuts(int score_list_size, const vector<int>& winners, const vector<float>& vals, 
+        const vector<int>& target_on, string target, int min_cut, int max_gap, float threshold, 
+        float min_coverage, CutList* cut_list);
 
-void CutMovie( ScoreList score_list, string movie_file, vector<int> target_list, 
-        string output_dir="", string temp_dir="/tmp", int total_targets = 6, int min_cut=5, 
-        int max_gap=2, float threshold=0.5, float min_coverage=0.4, bool do_concat=true,
-        bool remove_original = true);
+//max_temp is the most bytes of pieces kept in temp_dir, 0 for no limit.
+//The cuts found go in cuts. False with the reason in error if the movie
+//couldn't be cut.
+bool CutMovie( const ScoreMatrix& score_list, string movie_file, vector<int> target_list, 
+        string output_dir, string temp_dir, int total_targets, int min_cut, 
+        int max_gap, float threshold, float min_coverage, bool do_concat,
+        bool remove_original, long long max_temp, CutList* cuts, string* error);
 
-void TagTargets( ScoreList score_list, string movie_file, string output_dir, vector<string> labels,
-        int total_targets, int min_cut, int max_gap, float threshold, float min_coverage);
+//the cuts of every label, written to the tag files next to the movie (or
+//in output_dir) and to cuts. False with the reason in error if the tag
+//files couldn't be written.
+bool TagTargets( const ScoreMatrix& score_list, string movie_file, string output_dir, vector<string> labels,
+        int total_targets, int min_cut, int max_gap, float threshold, float min_coverage,
+        CutList* cuts, string* error);
 
 string PrettyTime(int seconds);
 
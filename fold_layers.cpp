@@ -0,0 +1,158 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <caffe/caffe.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "fold_layers.hpp"
+
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using namespace std;
+
+
+static LayerParameter* FindLayer(NetParameter* net, const string& name)
+{
+  for (int i = 0; i < net->layer_size(); ++i)
+    if (net->layer(i).name() == name)
+      return net->mutable_layer(i);
+  return NULL;
+}
+
+/* Older weights may be stored as doubles. */
+static float* FloatData(BlobProto* blob)
+{
+  if (blob->data_size() == 0 && blob->double_data_size() > 0)
+  {
+    for (int i = 0; i < blob->double_data_size(); ++i)
+      blob->add_data(blob->double_data(i));
+    blob->clear_double_data();
+  }
+  return blob->mutable_data()->mutable_data();
+}
+
+/* True if any layer but the ones at skip_a and skip_b reads blob. */
+static bool IsRead(const NetParameter& model, const string& blob,
+                   int skip_a, int skip_b)
+{
+  for (int i = 0; i < model.layer_size(); ++i)
+  {
+    if (i == skip_a || i == skip_b)
+      continue;
+    const LayerParameter& layer = model.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j)
+      if (layer.bottom(j) == blob)
+        return true;
+  }
+  return false;
+}
+
+/* The layer at i reads only the single blob written by the layer before. */
+static bool Follows(const NetParameter& model, int i, const string& type)
+{
+  if (i >= model.layer_size())
+    return false;
+  const LayerParameter& layer = model.layer(i);
+  const LayerParameter& prev = model.layer(i - 1);
+  return layer.type() == type && layer.bottom_size() == 1 &&
+         layer.top_size() == 1 && layer.bottom(0) == prev.top(0);
+}
+
+int FoldBatchNorm(NetParameter* model, NetParameter* weights)
+{
+  vector<bool> dropped(model->layer_size(), false);
+  int folded = 0;
+
+  for (int i = 0; i + 1 < model->layer_size(); ++i)
+  {
+    const LayerParameter& conv = model->layer(i);
+    if (conv.type() != "Convolution" || conv.top_size() != 1 ||
+        !Follows(*model, i + 1, "BatchNorm"))
+      continue;
+
+    const LayerParameter& bn = model->layer(i + 1);
+    bool has_scale = Follows(*model, i + 2, "Scale") &&
+                     model->layer(i + 2).scale_param().axis() == 1 &&
+                     model->layer(i + 2).scale_param().num_axes() == 1;
+    int last = has_scale ? i + 2 : i + 1;
+
+    /* Nobody else may see the output before normalization. */
+    if (bn.bottom(0) != bn.top(0) && IsRead(*model, bn.bottom(0), i + 1, -1))
+      continue;
+    if (has_scale && model->layer(i + 2).bottom(0) != model->layer(i + 2).top(0) &&
+        IsRead(*model, model->layer(i + 2).bottom(0), i + 2, -1))
+      continue;
+
+    LayerParameter* conv_w = FindLayer(weights, conv.name());
+    LayerParameter* bn_w = FindLayer(weights, bn.name());
+    LayerParameter* scale_w = has_scale ? FindLayer(weights, model->layer(i + 2).name()) : NULL;
+    if (!conv_w || conv_w->blobs_size() < 1 || !bn_w || bn_w->blobs_size() != 3 ||
+        (has_scale && (!scale_w || scale_w->blobs_size() < 1)))
+      continue;
+
+    int channels = conv.convolution_param().num_output();
+    int per_channel = conv_w->blobs(0).data_size() / channels;
+
+    /* BatchNorm keeps running sums, blob 2 holds the factor to divide
+     * them by to get the mean and variance. */
+    const float* bn_factor = FloatData(bn_w->mutable_blobs(2));
+    float factor = bn_factor[0] == 0 ? 0 : 1 / bn_factor[0];
+    const float* mean = FloatData(bn_w->mutable_blobs(0));
+    const float* variance = FloatData(bn_w->mutable_blobs(1));
+    float eps = bn.batch_norm_param().eps();
+
+    const float* gamma = has_scale ? FloatData(scale_w->mutable_blobs(0)) : NULL;
+    const float* beta = has_scale && scale_w->blobs_size() > 1 ?
+        FloatData(scale_w->mutable_blobs(1)) : NULL;
+
+    /* Give the convolution a bias to fold into if it doesn't have one. */
+    if (conv_w->blobs_size() < 2)
+    {
+      BlobProto* bias = conv_w->add_blobs();
+      bias->mutable_shape()->add_dim(channels);
+      for (int c = 0; c < channels; ++c)
+        bias->add_data(0);
+    }
+
+    float* w = FloatData(conv_w->mutable_blobs(0));
+    float* b = FloatData(conv_w->mutable_blobs(1));
+    for (int c = 0; c < channels; ++c)
+    {
+      float a = 1 / sqrt(variance[c] * factor + eps);
+      float shift = -mean[c] * factor * a;
+      if (gamma)
+      {
+        shift *= gamma[c];
+        a *= gamma[c];
+      }
+      if (beta)
+        shift += beta[c];
+
+      for (int k = 0; k < per_channel; ++k)
+        w[c * per_channel + k] *= a;
+      b[c] = b[c] * a + shift;
+    }
+
+    LayerParameter* conv_def = model->mutable_layer(i);
+    conv_def->mutable_convolution_param()->set_bias_term(true);
+    conv_def->set_top(0, model->layer(last).top(0));
+    for (int j = i + 1; j <= last; ++j)
+      dropped[j] = true;
+
+    ++folded;
+    i = last;
+  }
+
+  /* Rebuild the layer list without the folded layers. */
+  NetParameter kept;
+  kept.CopyFrom(*model);
+  kept.clear_layer();
+  for (int i = 0; i < model->layer_size(); ++i)
+    if (!dropped[i])
+      kept.add_layer()->CopyFrom(model->layer(i));
+  model->Swap(&kept);
+
+  return folded;
+}
@@ -0,0 +1,19 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef FOLD_LAYERS_HPP
+#define FOLD_LAYERS_HPP
+
+#include <caffe/caffe.hpp>
+
+/* Fold every BatchNorm (and the Scale after it) that directly follows a
+ * Convolution into that convolution's weights and bias. model is the
+ * net definition, weights the trained parameters; both are changed in
+ * place and the folded layers are dropped from model. At inference time
+ * BatchNorm and Scale are just a per-channel multiply and add, so the
+ * result is the same up to rounding, minus two passes over every
+ * convolution's output. Returns the number of convolutions folded. */
+int FoldBatchNorm(caffe::NetParameter* model, caffe::NetParameter* weights);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "frame_gate.hpp"
+#include "stats.hpp"
+
+//thumbnail size, small enough that noise and compression
+//artifacts average out
+static const int kThumbWidth = 32;
+static const int kThumbHeight = 18;
+
+//classify at least every this many seconds no matter what
+static const int kMaxRepeats = 10;
+
+FrameGate::FrameGate(double threshold)
+    : threshold_(threshold), repeats_(0), seen_(0), skipped_(0)
+{
+}
+
+bool FrameGate::Skip(const cv::Mat& frame)
+{
+    seen_++;
+    if(threshold_ <= 0)
+        return false;
+    StageTimer timer("gate");
+
+    //shrink first, so only the thumbnail's pixels are converted to gray
+    cv::Size size(kThumbWidth, kThumbHeight);
+    if(frame.channels() == 1)
+        cv::resize(frame, thumb_, size, 0, 0, cv::INTER_AREA);
+    else
+    {
+        cv::resize(frame, small_, size, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(small_, thumb_, frame.channels() == 4 ? cv::COLOR_BGRA2GRAY :
+                cv::COLOR_BGR2GRAY);
+    }
+
+    if(!reference_.empty() && repeats_ < kMaxRepeats)
+    {
+        double diff = cv::norm(thumb_, reference_, cv::NORM_L1) / thumb_.total();
+        if(diff < threshold_)
+        {
+            repeats_++;
+            skipped_++;
+            return true;
+        }
+    }
+
+    thumb_.copyTo(reference_);
+    repeats_ = 0;
+    return false;
+}
@@ -0,0 +1,38 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef FRAME_GATE_HPP
+#define FRAME_GATE_HPP
+
+#include <opencv2/core/core.hpp>
+
+//Decides which seconds are worth classifying. Each frame is shrunk to a
+//small gray thumbnail and compared with the thumbnail of the last frame
+//that was classified. If the mean difference is below threshold (in gray
+//levels, 0-255) the frame can reuse that frame's scores. Comparing with
+//the last classified frame, not the previous one, means a slow pan
+//still gets classified again once it has drifted far enough.
+class FrameGate
+{
+ public:
+    //threshold <= 0 never skips
+    explicit FrameGate(double threshold);
+
+    //true if frame can reuse the scores of the last frame not skipped
+    bool Skip(const cv::Mat& frame);
+
+    int Seen() const { return seen_; }
+    int Skipped() const { return skipped_; }
+
+ private:
+    double threshold_;
+    cv::Mat reference_;
+    cv::Mat small_;     //the frame shrunk, still in color
+    cv::Mat thumb_;
+    int repeats_;
+    int seen_;
+    int skipped_;
+};
+
+#endif
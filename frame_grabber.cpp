@@ -0,0 +1,136 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <cmath>
+#include <string>
+
+#include "frame_grabber.hpp"
+#include "stats.hpp"
+
+using namespace std;
+
+FrameGrabber::FrameGrabber(const string& movie_file)
+    : movie_file_(movie_file), cap_(movie_file), fps_(0.0), retrieved_time_(-1.0), duration_(-1), frame_idx_(0), next_second_(0)
+{
+    if(!cap_.isOpened())
+        return;
+
+    fps_ = cap_.get(CV_CAP_PROP_FPS);
+    double frame_count = cap_.get(CV_CAP_PROP_FRAME_COUNT);
+    if(fps_ > 0 && frame_count > 0)
+        duration_ = (int)ceil(frame_count / fps_);
+
+    int width = (int)cap_.get(CV_CAP_PROP_FRAME_WIDTH);
+    int height = (int)cap_.get(CV_CAP_PROP_FRAME_HEIGHT);
+    if(width > 0 && height > 0)
+        frame_size_ = cv::Size(width, height);
+}
+
+//time in seconds of the frame that was just grabbed
+double FrameGrabber::FrameTime()
+{
+    //constant frame rate is the common case and
+    //doesn't depend on the container's timestamps
+    if(fps_ > 0)
+        return (double)frame_idx_ / fps_;
+
+    return cap_.get(CV_CAP_PROP_POS_MSEC) / 1000.0;
+}
+
+bool FrameGrabber::Next(cv::Mat* frame)
+{
+    StageTimer timer("decode");
+
+    //the last frame also covers any seconds skipped by a gap
+    //in the timestamps (like the duplicates from -vf fps=1)
+    if(retrieved_time_ + 1e-6 >= next_second_ && (!frame || !retrieved_.empty()))
+    {
+        if(frame)
+            *frame = retrieved_.clone();
+        next_second_++;
+        return true;
+    }
+
+    //grab() only demuxes and decodes, the conversion to BGR
+    //in retrieve() is only paid for the frames we keep
+    while(cap_.grab())
+    {
+        double t = FrameTime();
+        frame_idx_++;
+
+        if(t + 1e-6 < next_second_)
+            continue;
+
+        if(!frame)
+        {
+            retrieved_.release();
+            retrieved_time_ = t;
+            next_second_++;
+            return true;
+        }
+
+        if(!cap_.retrieve(retrieved_) || retrieved_.empty())
+            return false;
+        retrieved_time_ = t;
+
+        //retrieve may hand back the decoder's own buffer
+        *frame = retrieved_.clone();
+        next_second_++;
+        return true;
+    }
+
+    return false;
+}
+
+bool FrameGrabber::Seek(int second)
+{
+    StageTimer timer("seek");
+    if(cap_.set(CV_CAP_PROP_POS_MSEC, second * 1000.0))
+    {
+        frame_idx_ = (int)cap_.get(CV_CAP_PROP_POS_FRAMES);
+        retrieved_.release();
+        retrieved_time_ = -1.0;
+        next_second_ = second;
+        return true;
+    }
+
+    //read through to it instead, from the start if it was passed already
+    //(which only works for a file, not a pipe or a stream)
+    if(second < next_second_)
+    {
+        cap_.release();
+        if(!cap_.open(movie_file_))
+            return false;
+        frame_idx_ = 0;
+        retrieved_.release();
+        retrieved_time_ = -1.0;
+        next_second_ = 0;
+    }
+    while(next_second_ < second)
+        if(!Next(NULL))
+            return false;
+    return true;
+}
+
+vector<cv::Mat> SampleFrames(const string& movie_file, int count)
+{
+    vector<cv::Mat> frames;
+    FrameGrabber grabber(movie_file);
+    if(!grabber.IsOpened())
+        return frames;
+
+    //only the samples are converted: seek to each one, which passes over
+    //the seconds in between where the container can't seek
+    int step = grabber.Duration() > count ? grabber.Duration() / count : 1;
+    cv::Mat frame;
+    for(int second=0; frames.size() < count; second += step)
+    {
+        if(second > 0 && step > 1 && !grabber.Seek(second))
+            break;
+        if(!grabber.Next(&frame))
+            break;
+        frames.push_back(frame);
+    }
+    return frames;
+}
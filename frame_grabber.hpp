@@ -0,0 +1,57 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef FRAME_GRABBER_HPP
+#define FRAME_GRABBER_HPP
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+
+//decodes a movie in-process and hands out one frame per second
+//(replaces the ffmpeg -vf fps=1 screenshots written to disk)
+class FrameGrabber
+{
+ public:
+    FrameGrabber(const string& movie_file);
+
+    bool IsOpened() const { return cap_.isOpened(); }
+
+    //get the frame for the next second, false when the movie is done.
+    //With frame NULL the second is passed over without converting it.
+    bool Next(cv::Mat* frame);
+
+    //continue from the frame at second, Next returns that second next.
+    //Where the container can't seek, the movie is read up to second
+    //instead (opened again first to go back). False if that fails too.
+    bool Seek(int second);
+
+    //estimated length of the movie in seconds (-1 if unknown)
+    int Duration() const { return duration_; }
+
+    //size of the frames as the container gives it, without decoding
+    //any (0x0 if unknown)
+    cv::Size FrameSize() const { return frame_size_; }
+
+ private:
+    double FrameTime();
+
+    string movie_file_;
+    cv::VideoCapture cap_;
+    cv::Mat retrieved_;
+    double fps_;
+    double retrieved_time_;
+    int duration_;
+    cv::Size frame_size_;
+    int frame_idx_;
+    int next_second_;
+};
+
+//up to count frames spread evenly over the movie
+vector<cv::Mat> SampleFrames(const string& movie_file, int count);
+
+#endif
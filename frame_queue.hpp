@@ -0,0 +1,98 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef FRAME_QUEUE_HPP
+#define FRAME_QUEUE_HPP
+
+#include <deque>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+//thread safe fifo with a fixed capacity. Push blocks while the queue
+//is full so a fast producer can't run ahead of the consumer, Pop blocks
+//while it is empty. Close() marks the end of the stream.
+template <typename T>
+class BoundedQueue
+{
+ public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+    //returns false if the queue was closed before there was room
+    bool Push(const T& item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(items_.size() >= capacity_ && !closed_)
+            not_full_.wait(lock);
+        if(closed_)
+            return false;
+
+        items_.push_back(item);
+        not_empty_.notify_one();
+        return true;
+    }
+
+    //returns false once the queue is closed and drained
+    bool Pop(T* item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(items_.empty() && !closed_)
+            not_empty_.wait(lock);
+        if(items_.empty())
+            return false;
+
+        *item = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    //like Pop, but gives up after waiting timeout_ms for an item
+    bool Pop(T* item, int timeout_ms)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        boost::system_time deadline = boost::get_system_time() +
+            boost::posix_time::milliseconds(timeout_ms);
+        while(items_.empty() && !closed_)
+            if(!not_empty_.timed_wait(lock, deadline))
+                break;
+        if(items_.empty())
+            return false;
+
+        *item = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    bool IsClosed()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return closed_;
+    }
+
+    size_t Size()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+ private:
+    boost::mutex mutex_;
+    boost::condition_variable not_full_;
+    boost::condition_variable not_empty_;
+    deque<T> items_;
+    size_t capacity_;
+    bool closed_;
+};
+
+#endif
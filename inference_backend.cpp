@@ -0,0 +1,35 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include "caffe_backend.hpp"
+#include "inference_backend.hpp"
+#include "opencv_backend.hpp"
+
+
+using namespace std;
+
+
+boost::shared_ptr<InferenceBackend> CreateBackend(const BackendOptions& options)
+{
+  if (options.name == "caffe")
+    return boost::shared_ptr<InferenceBackend>(new CaffeBackend(options));
+#ifdef USE_OPENCV_DNN
+  if (options.name == "opencv")
+    return boost::shared_ptr<InferenceBackend>(new OpenCVBackend(options));
+#endif
+
+  cerr << "Unknown backend: " << options.name << " (have: " << BackendNames() << ")" << endl;
+  exit(EXIT_FAILURE);
+}
+
+string BackendNames()
+{
+  string names = "caffe";
+#ifdef USE_OPENCV_DNN
+  names += ",opencv";
+#endif
+  return names;
+}
@@ -0,0 +1,70 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef INFERENCE_BACKEND_HPP
+#define INFERENCE_BACKEND_HPP
+
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+using namespace std;
+
+
+/* What a backend is created from. model_file is the net definition and
+ * trained_file the weights; for a backend reading a single file (like
+ * an ONNX model) model_file is ignored. threads is how many the network
+ * may use on the CPU, and cpu keeps it there in a GPU build. input_size
+ * and input_channels are the input for a backend that can't read it
+ * from the model, 0 for its default. */
+struct BackendOptions
+{
+  BackendOptions()
+      : name("caffe"), batch_size(1), threads(1), cpu(false), fold_layers(true),
+        int8(false), input_channels(0) {}
+
+  string name;
+  string model_file;
+  string trained_file;
+  int batch_size;
+  int threads;
+  bool cpu;
+  bool fold_layers;
+  bool int8;
+  cv::Size input_size;
+  int input_channels;
+};
+
+/* Runs the network for the Classifier. Input comes in as num images of
+ * planar float, already resized and mean subtracted, and the scores of
+ * image i go to row i of scores. Forward is only called from the thread
+ * that created the backend. */
+class InferenceBackend
+{
+ public:
+  virtual ~InferenceBackend() {}
+
+  virtual const char* Name() const = 0;
+
+  virtual cv::Size InputGeometry() const = 0;
+  virtual int NumChannels() const = 0;
+  virtual int NumOutputs() const = 0;
+
+  virtual void Forward(float* input, int num, float* scores) = 0;
+
+  /* INT8 calibration: frames forwarded between Begin and End are used
+   * to pick the quantization ranges. Only some backends have it. */
+  virtual bool HasInt8() const { return false; }
+  virtual void BeginCalibration() {}
+  virtual void EndCalibration() {}
+  virtual void SetInt8(bool on) {}
+};
+
+/* Exits with a message if options.name isn't a backend in this build. */
+boost::shared_ptr<InferenceBackend> CreateBackend(const BackendOptions& options);
+
+/* Names of the backends compiled in, comma separated. */
+string BackendNames();
+
+#endif
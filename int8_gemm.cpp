@@ -0,0 +1,224 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "int8_gemm.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INT8_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+void QuantizeInt8(const float* src, int n, float inv_scale, signed char* dst)
+{
+    for(int i=0; i < n; i++)
+    {
+        float v = nearbyintf(src[i] * inv_scale);
+        dst[i] = (signed char)max(-127.0f, min(127.0f, v));
+    }
+}
+
+void Int8RowSums(const signed char* a, int m, int k, int* sums)
+{
+    for(int i=0; i < m; i++)
+    {
+        int sum = 0;
+        for(int p=0; p < k; p++)
+            sum += a[(size_t)i * k + p];
+        sums[i] = sum;
+    }
+}
+
+static inline void StoreResult(int acc, int i, int j, const float* a_scales, float b_scale,
+        const float* bias, float* c, int c_row_stride, int c_col_stride)
+{
+    float v = acc * a_scales[i] * b_scale;
+    if(bias)
+        v += bias[i];
+    c[(size_t)i * c_row_stride + (size_t)j * c_col_stride] = v;
+}
+
+void Int8GemmScalar(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride)
+{
+    for(int i=0; i < m; i++)
+    {
+        const signed char* ai = a + (size_t)i * k;
+        for(int j=0; j < n; j++)
+        {
+            const signed char* bj = b + (size_t)j * k;
+            int acc = 0;
+            for(int p=0; p < k; p++)
+                acc += ai[p] * bj[p];
+            StoreResult(acc, i, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+        }
+    }
+}
+
+#ifdef INT8_X86
+
+__attribute__((target("avx2")))
+static inline int HorizontalSum(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+//16 int8 widened to 16 int16
+__attribute__((target("avx2")))
+static inline __m256i Load16(const signed char* p)
+{
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+//four rows of a against one row of b at a time, so each load of b is
+//used four times. madd_epi16 sums pairs of int16 products into int32,
+//which can't overflow for int8 inputs.
+__attribute__((target("avx2")))
+static void Int8GemmAVX2(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride)
+{
+    int i = 0;
+    for( ; i + 4 <= m; i += 4)
+    {
+        const signed char* a0 = a + (size_t)i * k;
+        const signed char* a1 = a0 + k;
+        const signed char* a2 = a1 + k;
+        const signed char* a3 = a2 + k;
+        for(int j=0; j < n; j++)
+        {
+            const signed char* bj = b + (size_t)j * k;
+            __m256i acc0 = _mm256_setzero_si256();
+            __m256i acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256();
+            __m256i acc3 = _mm256_setzero_si256();
+            for(int p=0; p < k; p += 16)
+            {
+                __m256i vb = Load16(bj + p);
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(Load16(a0 + p), vb));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(Load16(a1 + p), vb));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(Load16(a2 + p), vb));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(Load16(a3 + p), vb));
+            }
+            StoreResult(HorizontalSum(acc0), i, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc1), i+1, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc2), i+2, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc3), i+3, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+        }
+    }
+    for( ; i < m; i++)
+    {
+        const signed char* ai = a + (size_t)i * k;
+        for(int j=0; j < n; j++)
+        {
+            const signed char* bj = b + (size_t)j * k;
+            __m256i acc = _mm256_setzero_si256();
+            for(int p=0; p < k; p += 16)
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(Load16(ai + p), Load16(bj + p)));
+            StoreResult(HorizontalSum(acc), i, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+        }
+    }
+}
+
+//dpbusd multiplies unsigned by signed bytes and adds groups of four
+//straight into int32, 32 products per instruction. b is made unsigned
+//by adding 128 (flipping the sign bit), which adds 128 * sum(a_i) to
+//every dot product of row i, so that is taken off again at the end.
+__attribute__((target("avx2,avx512vnni,avx512vl")))
+static void Int8GemmVNNI(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride)
+{
+    const __m256i flip = _mm256_set1_epi8((char)0x80);
+    int i = 0;
+    for( ; i + 4 <= m; i += 4)
+    {
+        const signed char* a0 = a + (size_t)i * k;
+        const signed char* a1 = a0 + k;
+        const signed char* a2 = a1 + k;
+        const signed char* a3 = a2 + k;
+        for(int j=0; j < n; j++)
+        {
+            const signed char* bj = b + (size_t)j * k;
+            __m256i acc0 = _mm256_setzero_si256();
+            __m256i acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256();
+            __m256i acc3 = _mm256_setzero_si256();
+            for(int p=0; p < k; p += 32)
+            {
+                __m256i vb = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(bj + p)), flip);
+                acc0 = _mm256_dpbusd_epi32(acc0, vb, _mm256_loadu_si256((const __m256i*)(a0 + p)));
+                acc1 = _mm256_dpbusd_epi32(acc1, vb, _mm256_loadu_si256((const __m256i*)(a1 + p)));
+                acc2 = _mm256_dpbusd_epi32(acc2, vb, _mm256_loadu_si256((const __m256i*)(a2 + p)));
+                acc3 = _mm256_dpbusd_epi32(acc3, vb, _mm256_loadu_si256((const __m256i*)(a3 + p)));
+            }
+            StoreResult(HorizontalSum(acc0) - 128 * a_sums[i], i, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc1) - 128 * a_sums[i+1], i+1, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc2) - 128 * a_sums[i+2], i+2, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+            StoreResult(HorizontalSum(acc3) - 128 * a_sums[i+3], i+3, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+        }
+    }
+    for( ; i < m; i++)
+    {
+        const signed char* ai = a + (size_t)i * k;
+        for(int j=0; j < n; j++)
+        {
+            const signed char* bj = b + (size_t)j * k;
+            __m256i acc = _mm256_setzero_si256();
+            for(int p=0; p < k; p += 32)
+            {
+                __m256i vb = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(bj + p)), flip);
+                acc = _mm256_dpbusd_epi32(acc, vb, _mm256_loadu_si256((const __m256i*)(ai + p)));
+            }
+            StoreResult(HorizontalSum(acc) - 128 * a_sums[i], i, j, a_scales, b_scale, bias, c, c_row_stride, c_col_stride);
+        }
+    }
+}
+
+#endif
+
+typedef void (*GemmFn)(const signed char*, const int*, const float*, int,
+        const signed char*, float, int, int, const float*, float*, int, int);
+
+static GemmFn ChooseKernel(const char** name)
+{
+#ifdef INT8_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl"))
+    {
+        *name = "vnni";
+        return Int8GemmVNNI;
+    }
+    if(__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return Int8GemmAVX2;
+    }
+#endif
+    *name = "scalar";
+    return Int8GemmScalar;
+}
+
+static const char* kernel_name = "";
+static const GemmFn gemm_kernel = ChooseKernel(&kernel_name);
+
+void Int8Gemm(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride)
+{
+    gemm_kernel(a, a_sums, a_scales, m, b, b_scale, n, k, bias, c, c_row_stride, c_col_stride);
+}
+
+const char* Int8GemmKernel()
+{
+    return kernel_name;
+}
@@ -0,0 +1,36 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef INT8_GEMM_HPP
+#define INT8_GEMM_HPP
+
+//rows of int8 data are padded with zeros to a multiple of this
+const int kInt8Align = 32;
+
+inline int Int8Padded(int k) { return (k + kInt8Align - 1) / kInt8Align * kInt8Align; }
+
+//dst[i] = src[i] * inv_scale rounded to the nearest int and clamped to [-127,127]
+void QuantizeInt8(const float* src, int n, float inv_scale, signed char* dst);
+
+//sum of each of the m rows of a (k values each), needed by Int8Gemm
+void Int8RowSums(const signed char* a, int m, int k, int* sums);
+
+//Dequantized product of m rows of weights a with n rows of activations b,
+//both k long (k a multiple of kInt8Align). Element (i,j) is
+//    (a_i . b_j) * a_scales[i] * b_scale + bias[i]
+//and goes to c[i * c_row_stride + j * c_col_stride]. bias may be NULL.
+//Uses VNNI or AVX2 when the cpu has them.
+void Int8Gemm(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride);
+
+//same thing without SIMD, for reference
+void Int8GemmScalar(const signed char* a, const int* a_sums, const float* a_scales, int m,
+        const signed char* b, float b_scale, int n, int k,
+        const float* bias, float* c, int c_row_stride, int c_col_stride);
+
+//name of the kernel Int8Gemm uses on this machine
+const char* Int8GemmKernel();
+
+#endif
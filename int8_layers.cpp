@@ -0,0 +1,274 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <caffe/caffe.hpp>
+#include <caffe/layer_factory.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include "int8_gemm.hpp"
+#include "int8_layers.hpp"
+
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using namespace std;
+
+/* Output positions and output channels handed to a task at a time. */
+static const int kBlockCols = 64;
+static const int kBlockRows = 64;
+
+
+void Int8Layer::Observe(const float* data, int count)
+{
+  float m = max_input_;
+  for (int i = 0; i < count; ++i)
+    m = max(m, fabs(data[i]));
+  max_input_ = m;
+}
+
+void Int8Layer::QuantizeWeights(const float* weights, int rows, int k)
+{
+  padded_k_ = Int8Padded(k);
+  weights_.assign((size_t)rows * padded_k_, 0);
+  weight_sums_.resize(rows);
+  weight_scales_.resize(rows);
+
+  for (int i = 0; i < rows; ++i)
+  {
+    const float* row = weights + (size_t)i * k;
+    float m = 0;
+    for (int p = 0; p < k; ++p)
+      m = max(m, fabs(row[p]));
+    float scale = m > 0 ? m / 127 : 1;
+    weight_scales_[i] = scale;
+    QuantizeInt8(row, k, 1 / scale, &weights_[(size_t)i * padded_k_]);
+  }
+  Int8RowSums(&weights_[0], rows, padded_k_, &weight_sums_[0]);
+}
+
+void Int8Layer::ParallelFor(int n, const boost::function<void(int)>& fn)
+{
+  if (pool_)
+    pool_->ParallelFor(n, fn);
+  else
+    for (int i = 0; i < n; ++i)
+      fn(i);
+}
+
+void Int8ConvolutionLayer::Quantize()
+{
+  /* Caffe keeps the weights as out x channels x kh x kw. The patches
+   * are gathered from the height x width x channels input, so reorder
+   * the weights to out x kh x kw x channels to match. */
+  const float* w = this->blobs_[0]->cpu_data();
+  int spatial = this->kernel_shape_.cpu_data()[0] * this->kernel_shape_.cpu_data()[1];
+  int k = this->channels_ * spatial;
+  vector<float> reordered((size_t)this->num_output_ * k);
+  for (int o = 0; o < this->num_output_; ++o)
+    for (int c = 0; c < this->channels_; ++c)
+      for (int s = 0; s < spatial; ++s)
+        reordered[(size_t)o * k + s * this->channels_ + c] =
+            w[(size_t)o * k + c * spatial + s];
+
+  QuantizeWeights(&reordered[0], this->num_output_, k);
+}
+
+void Int8ConvolutionLayer::QuantizeImage(const float* input, float inv_scale)
+{
+  int channels = this->channels_;
+  int plane = this->conv_input_shape_.cpu_data()[1] * this->conv_input_shape_.cpu_data()[2];
+  input_.resize((size_t)plane * channels);
+
+  int blocks = (plane + kBlockCols - 1) / kBlockCols;
+  ParallelFor(blocks, [&](int b) {
+    vector<float> pixel(channels);
+    int end = min(plane, (b + 1) * kBlockCols);
+    for (int p = b * kBlockCols; p < end; ++p)
+    {
+      for (int c = 0; c < channels; ++c)
+        pixel[c] = input[(size_t)c * plane + p];
+      QuantizeInt8(&pixel[0], channels, inv_scale, &input_[(size_t)p * channels]);
+    }
+  });
+}
+
+/* Copy the patch under output positions begin ... end-1 into rows_. */
+void Int8ConvolutionLayer::Im2Row(int begin, int end)
+{
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  int height = this->conv_input_shape_.cpu_data()[1];
+  int width = this->conv_input_shape_.cpu_data()[2];
+  int out_width = this->output_shape_[1];
+  int channels = this->channels_;
+
+  for (int p = begin; p < end; ++p)
+  {
+    signed char* row = &rows_[(size_t)p * padded_k_];
+    int oy = p / out_width, ox = p % out_width;
+    for (int ky = 0; ky < kernel[0]; ++ky)
+    {
+      int y = oy * stride[0] - pad[0] + ky * dilation[0];
+      for (int kx = 0; kx < kernel[1]; ++kx)
+      {
+        int x = ox * stride[1] - pad[1] + kx * dilation[1];
+        if (y >= 0 && y < height && x >= 0 && x < width)
+          memcpy(row, &input_[((size_t)y * width + x) * channels], channels);
+        else
+          memset(row, 0, channels);
+        row += channels;
+      }
+    }
+    memset(row, 0, &rows_[(size_t)(p + 1) * padded_k_] - row);
+  }
+}
+
+void Int8ConvolutionLayer::Forward_cpu(const vector<Blob<float>*>& bottom,
+    const vector<Blob<float>*>& top)
+{
+  if (mode_ == CALIBRATE)
+    for (int i = 0; i < bottom.size(); ++i)
+      Observe(bottom[i]->cpu_data(), bottom[i]->count());
+
+  if (mode_ != INT8 || !quantized())
+  {
+    ConvolutionLayer<float>::Forward_cpu(bottom, top);
+    return;
+  }
+
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  int positions = this->output_shape_[0] * this->output_shape_[1];
+  int k = this->channels_ * kernel[0] * kernel[1];
+  int rows = this->num_output_;
+  const float* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+
+  /* A 1x1 convolution reads the quantized input as it is. */
+  bool direct = kernel[0] == 1 && kernel[1] == 1 && stride[0] == 1 && stride[1] == 1 &&
+      pad[0] == 0 && pad[1] == 0 && k == padded_k_;
+  float input_scale = max_input_ > 0 ? max_input_ / 127 : 1;
+
+  int col_blocks = (positions + kBlockCols - 1) / kBlockCols;
+  int row_blocks = (rows + kBlockRows - 1) / kBlockRows;
+  if (!direct)
+    rows_.resize((size_t)positions * padded_k_);
+
+  for (int i = 0; i < bottom.size(); ++i)
+  {
+    for (int n = 0; n < this->num_; ++n)
+    {
+      QuantizeImage(bottom[i]->cpu_data() + n * this->bottom_dim_, 1 / input_scale);
+      if (!direct)
+        ParallelFor(col_blocks, [&](int b) {
+          Im2Row(b * kBlockCols, min(positions, (b + 1) * kBlockCols));
+        });
+
+      const signed char* patches = direct ? &input_[0] : &rows_[0];
+      float* output = top[i]->mutable_cpu_data() + n * this->top_dim_;
+      ParallelFor(col_blocks * row_blocks, [&](int t) {
+        int r = (t % row_blocks) * kBlockRows;
+        int c = (t / row_blocks) * kBlockCols;
+        Int8Gemm(&weights_[(size_t)r * padded_k_], &weight_sums_[r], &weight_scales_[r],
+            min(kBlockRows, rows - r), patches + (size_t)c * padded_k_, input_scale,
+            min(kBlockCols, positions - c), padded_k_, bias ? bias + r : NULL,
+            output + (size_t)r * positions + c, positions, 1);
+      });
+    }
+  }
+}
+
+void Int8InnerProductLayer::Quantize()
+{
+  QuantizeWeights(this->blobs_[0]->cpu_data(), this->N_, this->K_);
+}
+
+void Int8InnerProductLayer::Forward_cpu(const vector<Blob<float>*>& bottom,
+    const vector<Blob<float>*>& top)
+{
+  if (mode_ == CALIBRATE)
+    Observe(bottom[0]->cpu_data(), bottom[0]->count());
+
+  if (mode_ != INT8 || !quantized())
+  {
+    InnerProductLayer<float>::Forward_cpu(bottom, top);
+    return;
+  }
+
+  float input_scale = max_input_ > 0 ? max_input_ / 127 : 1;
+  input_.assign((size_t)this->M_ * padded_k_, 0);
+  const float* input = bottom[0]->cpu_data();
+  for (int m = 0; m < this->M_; ++m)
+    QuantizeInt8(input + (size_t)m * this->K_, this->K_, 1 / input_scale,
+        &input_[(size_t)m * padded_k_]);
+
+  /* Outputs are M_ x N_, so row i of the weights is column i here. */
+  const float* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  float* output = top[0]->mutable_cpu_data();
+  int row_blocks = (this->N_ + kBlockRows - 1) / kBlockRows;
+  ParallelFor(row_blocks, [&](int b) {
+    int r = b * kBlockRows;
+    Int8Gemm(&weights_[(size_t)r * padded_k_], &weight_sums_[r], &weight_scales_[r],
+        min(kBlockRows, this->N_ - r), &input_[0], input_scale, this->M_, padded_k_,
+        bias ? bias + r : NULL, output + r, 1, this->N_);
+  });
+}
+
+
+static boost::shared_ptr<Layer<float> > CreateInt8Convolution(const LayerParameter& param)
+{
+  return boost::shared_ptr<Layer<float> >(new Int8ConvolutionLayer(param));
+}
+
+static boost::shared_ptr<Layer<float> > CreateInt8InnerProduct(const LayerParameter& param)
+{
+  return boost::shared_ptr<Layer<float> >(new Int8InnerProductLayer(param));
+}
+
+static LayerRegisterer<float> g_int8_convolution("Int8Convolution", CreateInt8Convolution);
+static LayerRegisterer<float> g_int8_inner_product("Int8InnerProduct", CreateInt8InnerProduct);
+
+
+/* Only 2D, single group, and in the usual channel axis. */
+static bool CanUseInt8(const LayerParameter& layer)
+{
+  if (layer.type() == "Convolution")
+  {
+    const ConvolutionParameter& conv = layer.convolution_param();
+    bool two_d = conv.kernel_size_size() <= 2 && conv.pad_size() <= 2 &&
+        conv.stride_size() <= 2 && conv.dilation_size() <= 2;
+    return two_d && conv.group() == 1 && conv.axis() == 1 && !conv.force_nd_im2col();
+  }
+  if (layer.type() == "InnerProduct")
+    return !layer.inner_product_param().transpose() &&
+        layer.inner_product_param().axis() == 1;
+  return false;
+}
+
+int UseInt8Layers(NetParameter* model)
+{
+  set<string> inputs;
+  for (int i = 0; i < model->input_size(); ++i)
+    inputs.insert(model->input(i));
+  for (int i = 0; i < model->layer_size(); ++i)
+    if (model->layer(i).type() == "Input")
+      for (int j = 0; j < model->layer(i).top_size(); ++j)
+        inputs.insert(model->layer(i).top(j));
+
+  int switched = 0;
+  for (int i = 0; i < model->layer_size(); ++i)
+  {
+    LayerParameter* layer = model->mutable_layer(i);
+    if (!CanUseInt8(*layer) || layer->bottom_size() != 1 || inputs.count(layer->bottom(0)))
+      continue;
+    layer->set_type("Int8" + layer->type());
+    ++switched;
+  }
+  return switched;
+}
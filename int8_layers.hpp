@@ -0,0 +1,104 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef INT8_LAYERS_HPP
+#define INT8_LAYERS_HPP
+
+#include <caffe/caffe.hpp>
+#include <caffe/layers/conv_layer.hpp>
+#include <caffe/layers/inner_product_layer.hpp>
+#include <vector>
+#include "thread_pool.hpp"
+
+/* The part shared by the int8 layers. They start out computing in float
+ * like the layers they replace. While calibrating they also record the
+ * largest input they see, and Quantize() then turns the float weights
+ * into int8 with one scale per output channel. In INT8 mode the input is
+ * quantized with a single scale taken from calibration, and the products
+ * are computed by Int8Gemm. */
+class Int8Layer
+{
+ public:
+  enum Mode { FLOAT, CALIBRATE, INT8 };
+
+  Int8Layer() : mode_(FLOAT), max_input_(0), pool_(NULL) {}
+  virtual ~Int8Layer() {}
+
+  /* INT8 only takes effect after Quantize(). */
+  void set_mode(Mode mode) { mode_ = mode; }
+  void set_thread_pool(ThreadPool* pool) { pool_ = pool; }
+
+  virtual void Quantize() = 0;
+
+ protected:
+  void Observe(const float* data, int count);
+
+  /* Quantize rows x k float weights into padded int8 rows. */
+  void QuantizeWeights(const float* weights, int rows, int k);
+
+  /* Run fn(0) ... fn(n-1) on the pool if there is one. */
+  void ParallelFor(int n, const boost::function<void(int)>& fn);
+
+  bool quantized() const { return !weight_scales_.empty(); }
+
+  Mode mode_;
+  float max_input_;
+  ThreadPool* pool_;
+
+  int padded_k_;
+  std::vector<signed char> weights_;
+  std::vector<int> weight_sums_;
+  std::vector<float> weight_scales_;
+};
+
+/* Convolution with 2 spatial axes and a single group. */
+class Int8ConvolutionLayer : public caffe::ConvolutionLayer<float>, public Int8Layer
+{
+ public:
+  explicit Int8ConvolutionLayer(const caffe::LayerParameter& param)
+      : caffe::ConvolutionLayer<float>(param) {}
+
+  virtual inline const char* type() const { return "Int8Convolution"; }
+
+  virtual void Quantize();
+
+ protected:
+  virtual void Forward_cpu(const std::vector<caffe::Blob<float>*>& bottom,
+      const std::vector<caffe::Blob<float>*>& top);
+
+ private:
+  void QuantizeImage(const float* input, float inv_scale);
+  void Im2Row(int begin, int end);
+
+  /* The input of one image as height x width x channels int8, and the
+   * patch under each output position laid out in the same order. */
+  std::vector<signed char> input_;
+  std::vector<signed char> rows_;
+};
+
+class Int8InnerProductLayer : public caffe::InnerProductLayer<float>, public Int8Layer
+{
+ public:
+  explicit Int8InnerProductLayer(const caffe::LayerParameter& param)
+      : caffe::InnerProductLayer<float>(param) {}
+
+  virtual inline const char* type() const { return "Int8InnerProduct"; }
+
+  virtual void Quantize();
+
+ protected:
+  virtual void Forward_cpu(const std::vector<caffe::Blob<float>*>& bottom,
+      const std::vector<caffe::Blob<float>*>& top);
+
+ private:
+  std::vector<signed char> input_;
+};
+
+/* Switch the Convolution and InnerProduct layers of model that the int8
+ * layers can run over to them. The layers reading the input image are
+ * left in float, its values are signed and spread out, and it is the
+ * layer most sensitive to rounding. Returns the number switched. */
+int UseInt8Layers(caffe::NetParameter* model);
+
+#endif
@@ -8,6 +8,9 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
 #include <iosfwd>
 #include <memory>
 #include <string>
@@ -15,91 +18,54 @@
 #include <utility>
 #include <vector>
 #include <stdlib.h>
+#include <getopt.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <fstream>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
+#include "adaptive.hpp"
+#include "autotune.hpp"
+#include "classifier.hpp"
 #include "cut_movie.hpp"
+#include "frame_grabber.hpp"
+#include "int8_gemm.hpp"
+#include "protocol.hpp"
+#include "scheduler.hpp"
+#include "score_cache.hpp"
+#include "stats.hpp"
+#include "server.hpp"
 #include "util.hpp"
+#include "workers.hpp"
 
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using namespace std;
 using std::string;
 
-int global_ffmpeg_done = -1;
 
+//frames used to calibrate and check INT8
+const int kCalibrationFrames = 100;
+const int kValidationFrames = 500;
 
-class Classifier 
-{
- public:
-  Classifier(const string& model_file,
-             const string& trained_file,
-             const string& mean_file,
-             const string& label_file);
-
-  ScoreList  Classify(const vector<cv::Mat>& imgs);
-
-  std::vector<string> labels_;
-
- private:
-  void SetMean(const string& mean_file);
-
-  std::vector<vector<float> > Predict(const vector<cv::Mat>& imgs);
-
-  void WrapInputLayer(std::vector<cv::Mat>* input_channels, int n);
+//frames auto-tuning runs on, and their size when there is no movie
+const int kTuneFrames = 32;
+const int kTuneWidth = 1280;
+const int kTuneHeight = 720;
 
-  void Preprocess(const cv::Mat& img,
-                  std::vector<cv::Mat>* input_channels);
+//frames a decoder keeps inside ffmpeg, a guess for the memory budget,
+//and the frame size assumed when there is no movie to look at
+const int kDecoderFrames = 8;
+const int kDefaultFrameWidth = 1920;
+const int kDefaultFrameHeight = 1080;
 
- private:
-  boost::shared_ptr<Net<float> > net_;
-  cv::Size input_geometry_;
-  int num_channels_;
-  cv::Mat mean_;
+//options that only have a long name
+enum { kMaxMemoryOption = 256, kMaxTempOption };
+const struct option long_options[] = {
+    {"max-memory", required_argument, NULL, kMaxMemoryOption},
+    {"max-temp", required_argument, NULL, kMaxTempOption},
+    {NULL, 0, NULL, 0}
 };
 
-Classifier::Classifier(const string& model_file,
-                       const string& trained_file,
-                       const string& mean_file,
-                       const string& label_file) 
-{
-#ifdef CPU_ONLY
-  Caffe::set_mode(Caffe::CPU);
-#else
-  Caffe::set_mode(Caffe::GPU);
-#endif
-
-
-  /* Load the network. */
-  net_.reset(new Net<float>(model_file, TEST));
-  net_->CopyTrainedLayersFrom(trained_file);
-
-  CHECK_EQ(net_->num_inputs(), 1) << "Network should have exactly one input.";
-  CHECK_EQ(net_->num_outputs(), 1) << "Network should have exactly one output.";
-
-  Blob<float>* input_layer = net_->input_blobs()[0];
-  num_channels_ = input_layer->channels();
-  CHECK(num_channels_ == 3 || num_channels_ == 1)
-    << "Input layer should have 1 or 3 channels.";
-  input_geometry_ = cv::Size(input_layer->width(), input_layer->height());
-
-  /* Load the binaryproto mean file. */
-  SetMean(mean_file);
-
-  /* Load labels. */
-  std::ifstream labels(label_file.c_str());
-  CHECK(labels) << "Unable to open labels file " << label_file;
-  string line;
-  while (std::getline(labels, line))
-    labels_.push_back(string(line));
-
-  Blob<float>* output_layer = net_->output_blobs()[0];
-  CHECK_EQ(labels_.size(), output_layer->channels())
-    << "Number of labels is different from the output layer dimension.";
-}
-
-
 //Utility Functions
 
 int IndexOf(string label, vector<string> labels)
@@ -112,65 +78,9 @@ int IndexOf(string label, vector<string> labels)
     exit(EXIT_FAILURE);
 }
 
-string FormatFileNumber(int file_no) 
-{
-    ostringstream out;
-    out << std::internal << std::setfill('0') << std::setw(5) << file_no;
-    return out.str();
-}
-
-
-inline bool FileExists(const std::string& name) 
-{
-    ifstream f(name.c_str());
-    return f.good();
-}
-
-int CountFiles(string directory)
-{
-    DIR *dir;
-    struct dirent *ent;
-    int n=0;
-    if ((dir = opendir (directory.c_str())) != NULL)
-    {
-        n = 0;
-        while ((ent = readdir(dir)) != NULL) n++;
-        closedir(dir);
-        return n-2; //-2 for . and ..
-    }
-    else
-    {
-        cerr << "Could not open directory: " << directory << endl;
-        exit(EXIT_FAILURE);
-    }
-}
-
-void CreateScreenShots(string movie_file, string screenshot_directory)
-{
-  //turn movie into 1 second screenshots
-  
-  string mkdir_cmd = "mkdir -p " + screenshot_directory;
-  if(system(mkdir_cmd.c_str()))
-  {
-      cerr << "Command failed: " << mkdir_cmd << endl;
-      exit(EXIT_FAILURE);
-  }
-
-  string screenshot_cmd = "ffmpeg -loglevel 8 -i \"" + movie_file + "\" -vf fps=1 -q:v 1 " +
-            screenshot_directory + "img_\%05d.jpg";
-  if(system(screenshot_cmd.c_str()))
-  {
-      cerr << "Error getting screenshots from: " << movie_file << endl;
-      exit(EXIT_FAILURE);
-  }
-  
-  global_ffmpeg_done = CountFiles(screenshot_directory);
-
-}
-
 void PrintUsage(char* prog_name)
 {
-    cout << "Usage: " << prog_name << " [-t target|-x|-a] [-b batch_size] [-o output_dir] [options] movie_file" << endl;
+    cout << "Usage: " << prog_name << " [-t target|-x|-a] [-b batch_size] [-o output_dir] [options] movie_file|directory ..." << endl;
     cout << "-h\tPrint more help information about options" << endl;
 }
 
@@ -184,6 +94,36 @@ void PrintHelp()
     cout << "-b\tBatch size (default: 32) - decrease if you run out of memory" << endl;
     cout << "-o\tOutput directory (default: same as input)" << endl;
     cout << "-d\tTemporary Directory (default: /tmp)" << endl;
+    cout << "-j\tThreads used to preprocess frames (default: number of cores)" << endl;
+    cout << "-J\tThreads used by the network on the CPU (default: same as -j)" << endl;
+    cout << "-A\tAuto-tune the batch size and threads for this machine. Measured once and" << endl;
+    cout << "\tkept in the cache directory (see -C). Ignores -b, -j and -J" << endl;
+    cout << "-e\tClassify Every n-th second first, then only go back for the seconds" << endl;
+    cout << "\tbetween where the label changes or the score crosses or is near -s (default: 1 = off)" << endl;
+    cout << "-z\tReuse the scores of the last classified frame when a frame differs from it" << endl;
+    cout << "\tby less than this (mean gray levels 0-255, default: 0 = off, try 3). Not with -e" << endl;
+    cout << "-C\tCache directory for the scores of movies, so changing the cut settings" << endl;
+    cout << "\tdoesn't classify them again (default: " << DefaultCacheDirectory() << ", off to disable)" << endl;
+    cout << endl;
+    cout << "Batch Options" << endl;
+    cout << "-i\tRead movie paths from a list file, one per line (- for stdin)" << endl;
+    cout << "-k\tNumber of movies decoded and batched together (default: 2)" << endl;
+    cout << "-T\tWrite the Timings of each stage to this file at the end, .json or .csv" << endl;
+    cout << "\tWith -W each worker writes its own, named like timings.worker0.json" << endl;
+    cout << "-W\tNumber of Worker processes, each with its own copy of the model pinned to" << endl;
+    cout << "\tits own cores and NUMA node. Movies go to whichever is free. 0 for one per" << endl;
+    cout << "\tNUMA node (default: 1 = off)" << endl;
+    cout << endl;
+    cout << "Memory Options" << endl;
+    cout << "--max-memory MB\tKeep the memory used under this by using smaller batches and" << endl;
+    cout << "\t\tfewer frames queued and movies decoding (default: no limit)" << endl;
+    cout << "--max-temp MB\tKeep the cut pieces in the temp directory under this by moving" << endl;
+    cout << "\t\tthem next to the output as they are done (default: no limit)" << endl;
+    cout << endl;
+    cout << "Server Options" << endl;
+    cout << "-S\tKeep the model loaded and serve jobs on a Socket, the path is optional" << endl;
+    cout << "\t(default: " << kDefaultSocket << ", the same as miles-deep-client)" << endl;
+    cout << "\tUse miles-deep-client to send movies to it" << endl;
     cout << endl;
     cout << "Cutting Options" << endl;
     cout << "-u\tMinimum cUt in seconds (default: 4)" << endl;
@@ -192,12 +132,19 @@ void PrintHelp()
     cout << "-v\tMinimum coVerage of target frames in a cut (default: 0.4) [0-1]" << endl;
     cout << "-c\tDon't Concatenate. Output cut directory (default: off)" << endl;
     cout << "-n\tDoN't ask to remove original movie file (default: off)" << endl;
+    cout << "-L\tLive cutting: start cutting pieces while the movie is still being classified." << endl;
+    cout << "\tIgnored with -a and -e (default: off)" << endl;
     cout << endl;
     cout << "Model Options" << endl;
+    cout << "-B\tBackend running the model: " << BackendNames() << " (default: caffe)" << endl;
     cout << "-m\tMean file .binaryproto" << endl;
     cout << "-p\tDefinition of model .prototxt" << endl;
     cout << "-w\tWeights for model .caffemodel" << endl;
     cout << "-l\tLabel file" << endl;
+    cout << "-F\tDon't Fold BatchNorm and Scale layers into the convolutions (default: fold)" << endl;
+    cout << "-I\tInput size of the model for -B opencv, WxH or WxHxC (default: 224x224x3)" << endl;
+    cout << "-q\tQuantize to INT8 (CPU only), calibrated on frames of the given movie" << endl;
+    cout << "-Q\tCompare INT8 with float on frames of the given movie and exit. Needs -q" << endl;
 }
 
 vector<string> Split(const string &s, char delim) 
@@ -212,6 +159,50 @@ vector<string> Split(const string &s, char delim)
     return tokens;
 }
 
+const char* movie_extensions[] = {".mp4", ".m4v", ".mkv", ".avi", ".wmv", ".mov",
+    ".flv", ".webm", ".mpg", ".mpeg", ".ts", ".3gp", NULL};
+
+bool IsMovieFile(const string& path)
+{
+    string ext = getFileExtension(path);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for(int i=0; movie_extensions[i] != NULL; i++)
+        if(ext == movie_extensions[i])
+            return true;
+    return false;
+}
+
+//add a movie, or the movies in a directory, to the list
+void AddMovies(const string& path, vector<string>* movie_files)
+{
+    if(!isDirectory(path))
+    {
+        movie_files->push_back(path);
+        return;
+    }
+
+    vector<string> files = listDirectory(path);
+    for(int i=0; i<files.size(); i++)
+        if(IsMovieFile(files[i]))
+            movie_files->push_back(files[i]);
+}
+
+vector<string> ReadLabels(const string& label_file)
+{
+    ifstream f(label_file.c_str());
+    if(!f)
+    {
+        cerr << "Unable to open labels file " << label_file << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    vector<string> labels;
+    string line;
+    while(getline(f, line))
+        labels.push_back(line);
+    return labels;
+}
+
 vector<string> allExceptOther(vector<string> labels)
 {
     vector<string> output;
@@ -224,154 +215,261 @@ vector<string> allExceptOther(vector<string> labels)
 }
 
 
-//Classifier Class Functions
+//at most n holders at a time
+class Slots
+{
+ public:
+    explicit Slots(int n) : free_(n) {}
 
+    void Acquire()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(free_ == 0)
+            released_.wait(lock);
+        free_--;
+    }
 
-/* Return the all predictions. */
-ScoreList Classifier::Classify(const vector<cv::Mat>& imgs) 
+    void Release()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        free_++;
+        released_.notify_one();
+    }
+
+ private:
+    boost::mutex mutex_;
+    boost::condition_variable released_;
+    int free_;
+};
+
+//print some progress updates
+void PrintProgress(const string& prefix, int seconds, int duration, int report_interval)
 {
-  ScoreList outputs = Predict(imgs);
-return outputs;
+    if(seconds % report_interval != 0)
+        return;
+
+    ostringstream progress;
+    progress << prefix << PrettyTime(seconds);
+    if(duration > 0)
+        progress << "/" << PrettyTime(duration);
+    progress << '\n';
+    cout << progress.str() << flush;
 }
 
-/* Load the mean file in binaryproto format. */
-void Classifier::SetMean(const string& mean_file) 
+//quantize the classifier on frames of one movie, and if there is a
+//validation movie report how often it still agrees with float there.
+//At most max_frames are held at once.
+void CalibrateInt8(Classifier* classifier, const string& calibration_movie,
+        const string& validation_movie, int max_frames)
 {
-  BlobProto blob_proto;
-  ReadProtoFromBinaryFileOrDie(mean_file.c_str(), &blob_proto);
-
-  /* Convert from BlobProto to Blob<float> */
-  Blob<float> mean_blob;
-  mean_blob.FromProto(blob_proto);
-  CHECK_EQ(mean_blob.channels(), num_channels_)
-    << "Number of channels of mean file doesn't match input layer.";
-
-  /* The format of the mean file is planar 32-bit float BGR or grayscale. */
-  std::vector<cv::Mat> channels;
-  float* data = mean_blob.mutable_cpu_data();
-  for (int i = 0; i < num_channels_; ++i) 
-  {
-    /* Extract an individual channel. */
-    cv::Mat channel(mean_blob.height(), mean_blob.width(), CV_32FC1, data);
-    channels.push_back(channel);
-    data += mean_blob.height() * mean_blob.width();
-  }
-
-  /* Merge the separate channels into a single image. */
-  cv::Mat mean;
-  cv::merge(channels, mean);
+    vector<cv::Mat> frames = SampleFrames(calibration_movie, min(kCalibrationFrames, max_frames));
+    if(frames.empty())
+    {
+        cerr << "Error opening calibration movie: " << calibration_movie << endl;
+        exit(EXIT_FAILURE);
+    }
+    cout << "Calibrating INT8 on " << frames.size() << " frames (" 
+        << Int8GemmKernel() << ")" << endl;
+    classifier->Calibrate(frames);
 
-  /* Compute the global mean pixel value and create a mean image
-   * filled with this value. */
-  cv::Scalar channel_mean = cv::mean(mean);
-  mean_ = cv::Mat(input_geometry_, mean.type(), channel_mean);
-}
+    if(validation_movie == "")
+        return;
 
-std::vector<vector<float> > Classifier::Predict(const vector<cv::Mat>& imgs) 
-{
-  Blob<float>* input_layer = net_->input_blobs()[0];
-  input_layer->Reshape(imgs.size(), num_channels_,
-                       input_geometry_.height, input_geometry_.width);
-  /* Forward dimension change to all layers. */
-  net_->Reshape();
+    frames = SampleFrames(validation_movie, min(kValidationFrames, max_frames));
+    if(frames.empty())
+    {
+        cerr << "Error opening validation movie: " << validation_movie << endl;
+        exit(EXIT_FAILURE);
+    }
 
-  for( int i=0; i < imgs.size(); ++i)
-  {
-      vector<cv::Mat> input_channels;
-      WrapInputLayer(&input_channels,i);
-      Preprocess(imgs[i], &input_channels);
-  }
+    classifier->SetInt8(false);
+    ScoreMatrix reference = classifier->Classify(frames);
+    classifier->SetInt8(true);
+    ScoreMatrix quantized = classifier->Classify(frames);
 
-  net_->Forward();
+    int rows = reference.rows();
+    vector<int> ref_winners(rows), int8_winners(rows);
+    vector<float> ref_vals(rows), int8_vals(rows);
+    scoreArgMaxRows(reference.data(), rows, reference.cols(), &ref_winners[0], &ref_vals[0]);
+    scoreArgMaxRows(quantized.data(), rows, quantized.cols(), &int8_winners[0], &int8_vals[0]);
 
-  vector<vector<float> > outputs;
+    int agree = 0;
+    float max_diff = 0;
+    for(int i=0; i < rows; i++)
+    {
+        if(ref_winners[i] == int8_winners[i])
+            agree++;
+        for(int j=0; j < reference.cols(); j++)
+            max_diff = max(max_diff, fabs(reference.row(i)[j] - quantized.row(i)[j]));
+    }
 
-  Blob<float>* output_layer = net_->output_blobs()[0];
-  for( int i=0; i < output_layer->num(); ++i)
-  {
-      const float* begin = output_layer->cpu_data() + i * output_layer->channels();
-      const float* end = begin + output_layer->channels();
-      /* Copy the output layer to a std::vector */
-      outputs.push_back(vector<float>(begin, end));
-  }
-  return outputs;
+    cout << "INT8 agrees with float on " << agree << "/" << rows << " frames ("
+        << 100.0 * agree / rows << "%), largest score difference " << max_diff << endl;
+    exit(0);
 }
 
-/* Wrap the input layer of the network in separate cv::Mat objects
- * (one per channel). This way we save one memcpy operation and we
- * don't need to rely on cudaMemcpy2D. The last preprocessing
- * operation will write the separate channels directly to the input
- * layer. */
-void Classifier::WrapInputLayer(std::vector<cv::Mat>* input_channels, int n) 
+//pick the batch size and threads on frames like the ones to classify
+TuneSettings TuneClassifier(const BackendOptions& backend_options, const string& mean_file,
+        const string& label_file, const string& movie_file, const string& cache_directory,
+        double memory_budget_mb)
 {
-  Blob<float>* input_layer = net_->input_blobs()[0];
-
-  int width = input_layer->width();
-  int height = input_layer->height();
-  int channels = input_layer->channels();
-  float* input_data = input_layer->mutable_cpu_data() + n * width * height * channels;
-  for (int i = 0; i < channels; ++i) 
-  {
-    cv::Mat channel(height, width, CV_32FC1, input_data);
-    input_channels->push_back(channel);
-    input_data += width * height;
-  }
+    //the resolution of the movie, from the container or else its first
+    //frame, so a cached result doesn't need any frames decoded
+    cv::Size size;
+    if(movie_file != "")
+    {
+        FrameGrabber grabber(movie_file);
+        cv::Mat frame;
+        if(grabber.FrameSize().area() > 0)
+            size = grabber.FrameSize();
+        else if(grabber.IsOpened() && grabber.Next(&frame))
+            size = frame.size();
+    }
+    if(size.area() <= 0)
+        size = cv::Size(kTuneWidth, kTuneHeight);
+
+    //the same model at the same resolution can use the same settings
+    uint64_t key = HashFile(backend_options.trained_file);
+    key = HashFile(backend_options.model_file, key);
+    ostringstream settings;
+    settings << backend_options.name << " fold=" << backend_options.fold_layers << " int8="
+        << backend_options.int8 << " size=" << size.width << "x" << size.height;
+    if(backend_options.input_size.area() > 0)
+        settings << " input=" << backend_options.input_size.width << "x"
+            << backend_options.input_size.height << "x" << backend_options.input_channels;
+    key = HashString(settings.str(), key);
+    string cache_file = TuneCacheFile(cache_directory, key);
+
+    //only a new model or resolution needs frames to measure on
+    TuneSettings tuned;
+    if(cache_file == "" || !ReadTuneSettings(cache_file, &tuned))
+    {
+        vector<cv::Mat> frames;
+        if(movie_file != "")
+            frames = SampleFrames(movie_file, kTuneFrames);
+        if(frames.empty())
+            for(int i=0; i < kTuneFrames; i++)
+            {
+                cv::Mat frame(size.height, size.width, CV_8UC3);
+                cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+                frames.push_back(frame);
+            }
+        tuned = AutoTune(backend_options, mean_file, label_file, frames, memory_budget_mb,
+                cache_file);
+    }
+    cout << "Auto-tune" << (tuned.cached ? " (cached)" : "") << ": batch size " 
+        << tuned.batch_size << ", " << tuned.forward_threads << " network threads, " 
+        << tuned.preprocess_threads << " preprocess threads, " << tuned.frames_per_s 
+        << " frames/s" << endl;
+    return tuned;
 }
 
-void Classifier::Preprocess(const cv::Mat& img,
-                            std::vector<cv::Mat>* input_channels) 
+//MB of a decoded frame of the biggest of the first count movies to classify
+double FrameMB(const vector<string>& movie_files, const vector<bool>& hit, int count)
 {
-  /* Convert the input image to the input image format of the network. */
-  cv::Mat sample;
-  if (img.channels() == 3 && num_channels_ == 1)
-    cv::cvtColor(img, sample, cv::COLOR_BGR2GRAY);
-  else if (img.channels() == 4 && num_channels_ == 1)
-    cv::cvtColor(img, sample, cv::COLOR_BGRA2GRAY);
-  else if (img.channels() == 4 && num_channels_ == 3)
-    cv::cvtColor(img, sample, cv::COLOR_BGRA2BGR);
-  else if (img.channels() == 1 && num_channels_ == 3)
-    cv::cvtColor(img, sample, cv::COLOR_GRAY2BGR);
-  else
-    sample = img;
-
-  cv::Mat sample_resized;
-  if (sample.size() != input_geometry_)
-    cv::resize(sample, sample_resized, input_geometry_);
-  else
-    sample_resized = sample;
-
-  cv::Mat sample_float;
-  if (num_channels_ == 3)
-    sample_resized.convertTo(sample_float, CV_32FC3);
-  else
-    sample_resized.convertTo(sample_float, CV_32FC1);
-
-  cv::Mat sample_normalized;
-  cv::subtract(sample_float, mean_, sample_normalized);
+    double frame_mb = 0;
+    for(int m=0; m<movie_files.size() && count > 0; m++)
+    {
+        if(hit[m])
+            continue;
+        vector<cv::Mat> frames = SampleFrames(movie_files[m], 1);
+        if(!frames.empty())
+            frame_mb = max(frame_mb, frames[0].total() * frames[0].elemSize() / 1048576.0);
+        count--;
+    }
+    if(frame_mb == 0)
+        frame_mb = kDefaultFrameWidth * kDefaultFrameHeight * 3 / 1048576.0;
+    return frame_mb;
+}
 
-  /* This operation will write the separate BGR planes directly to the
-   * input layer of the network because it is wrapped by the cv::Mat
-   * objects in input_channels. */
-  cv::split(sample_normalized, *input_channels);
+//memory of the frames on their way to the network. A movie holds on to
+//its decoder until it is cut, and twice as many movies as are decoding
+//can be waiting for that. Then the frames wait in the queue and in the
+//batch being filled, and two batches are staged as floats.
+double PipelineMB(int batch_size, int queue_size, int decoders, double frame_mb,
+        double input_mb)
+{
+    return (2 * decoders * kDecoderFrames + queue_size + batch_size) * frame_mb 
+        + 2 * batch_size * input_mb;
+}
 
+//Load the classifier with the biggest batch size, up to the one in
+//options, that leaves room for at least one movie decoding and one frame
+//queued inside max_memory_mb (0 for no limit). The batch size is
+//changed in options.
+boost::shared_ptr<Classifier> FitClassifier(BackendOptions* options, const string& mean_file,
+        const string& label_file, int preprocess_threads, double frame_mb, double max_memory_mb)
+{
+    boost::shared_ptr<Classifier> classifier;
+    while(true)
+    {
+        classifier.reset();
+        classifier.reset(new Classifier(*options, mean_file, label_file, preprocess_threads));
+        if(max_memory_mb <= 0)
+            return classifier;
+
+        //the network allocates its buffers on the first batch
+        int batch_size = options->batch_size;
+        cv::Mat blank(kTuneHeight, kTuneWidth, CV_8UC3, cv::Scalar::all(0));
+        classifier->Classify(vector<cv::Mat>(batch_size, blank));
+        double input_mb = classifier->InputSize() * sizeof(float) / 1048576.0;
+        double need = residentMemoryMB() + PipelineMB(batch_size, 1, 1, frame_mb, input_mb);
+        if(need <= max_memory_mb || batch_size == 1)
+            return classifier;
+        options->batch_size = batch_size / 2;
+    }
 }
 
+//the peaks of the run, and its timings if asked for
+void EndOfRun(const string& report_file)
+{
+    double peak_mb = peakMemoryMB();
+    double temp_mb = PeakTempBytes() / 1048576.0;
+    RecordValue("peak_memory_mb", peak_mb);
+    RecordValue("peak_temp_mb", temp_mb);
+    cout << "Peak memory: " << (int)peak_mb << " MB, peak temp: " << (int)temp_mb << " MB" << endl;
+
+    if(report_file == "")
+        return;
+    if(!WriteStatsReport(report_file))
+    {
+        cerr << "Cannot write report: " << report_file << endl;
+        return;
+    }
+    cout << "Timings written to: " << report_file << endl;
+}
 
 int main(int argc, char** argv) 
 {
   
   int batch_size = 32;
-  int MAX_IMG_IDX = 99999;
+  int preprocess_threads = 0;
+  int forward_threads = 0;
+  int workers = 1;
+  bool auto_tune = false;
+  double max_memory_mb = 0;
+  double max_temp_mb = 0;
+  bool fold_layers = true;
+  string backend = "caffe";
+  string input_shape = "";
+  string calibration_movie = "";
+  string validation_movie = "";
   int report_interval = 100;
-  int sleep_time = 1;
   int min_cut = 4;
   int max_gap = 2;
   double min_score = 0.5;
   double min_coverage = 0.4;
   vector<string> target_list;
   target_list.push_back("blowjob_handjob");  //the default target
-  string movie_file;
-  string screenshot_directory = "/tmp/screenshots/";
+  vector<string> movie_files;
+  string list_file = "";
+  int decoders = 2;
+  string socket_path = "";
+  double skip_threshold = 0;
+  int sample_stride = 1;
+  bool stream_cuts = false;
+  string report_file = "";
+  string cache_directory = DefaultCacheDirectory();
 
   string model_dir = "model/";
   string model_weights = model_dir + "weights.caffemodel";
@@ -391,9 +489,16 @@ int main(int argc, char** argv)
   //parse command line flags
   int opt;
   bool set_all_but_other = false;
-  while ((opt = getopt(argc, argv, "act:b:d:o:m:ng:s:hxp:w:u:l:v:")) != -1) 
+  while ((opt = getopt_long(argc, argv, "act:b:d:i:j:J:Ak:o:m:ng:s:hxp:w:u:l:v:S::Fq:Q:B:I:z:e:C:LT:W:",
+                  long_options, NULL)) != -1) 
   {
         switch (opt) {
+        case kMaxMemoryOption:
+            max_memory_mb = atof(optarg);
+            break;
+        case kMaxTempOption:
+            max_temp_mb = atof(optarg);
+            break;
         case 'a':
             auto_tag = true;
             break;
@@ -409,9 +514,34 @@ int main(int argc, char** argv)
         case 'd':
             temp_directory = optarg;
             break;
+        case 'j':
+            preprocess_threads = atoi(optarg);
+            break;
+        case 'J':
+            forward_threads = atoi(optarg);
+            break;
+        case 'A':
+            auto_tune = true;
+            break;
+        case 'i':
+            list_file = optarg;
+            break;
+        case 'k':
+            decoders = max(1, atoi(optarg));
+            break;
         case 'o':
             output_directory = optarg;
             break;
+        case 'S':
+            //-S alone serves on the default socket. The server takes no
+            //movies, so a path after -S is the socket's either way.
+            if(optarg)
+                socket_path = optarg;
+            else if(optind < argc && argv[optind][0] != '-')
+                socket_path = argv[optind++];
+            else
+                socket_path = kDefaultSocket;
+            break;
         case 'u':
             min_cut = atoi(optarg);
             break;
@@ -436,6 +566,39 @@ int main(int argc, char** argv)
         case 'l':
             label_file = optarg;
             break;
+        case 'F':
+            fold_layers = false;
+            break;
+        case 'e':
+            sample_stride = max(1, atoi(optarg));
+            break;
+        case 'C':
+            cache_directory = string(optarg) == "off" ? "" : optarg;
+            break;
+        case 'T':
+            report_file = optarg;
+            break;
+        case 'W':
+            workers = atoi(optarg);
+            break;
+        case 'L':
+            stream_cuts = true;
+            break;
+        case 'z':
+            skip_threshold = atof(optarg);
+            break;
+        case 'B':
+            backend = optarg;
+            break;
+        case 'I':
+            input_shape = optarg;
+            break;
+        case 'q':
+            calibration_movie = optarg;
+            break;
+        case 'Q':
+            validation_movie = optarg;
+            break;
         case 'n':
             remove_original = false; 
             break;
@@ -451,24 +614,214 @@ int main(int argc, char** argv)
         }
   }
 
-  if(optind >= argc)
+  for(int i=optind; i<argc; i++)
+      AddMovies(argv[i], &movie_files);
+
+  if(list_file != "")
+  {
+      ifstream list_stream;
+      if(list_file != "-")
+      {
+          list_stream.open(list_file.c_str());
+          if(!list_stream)
+          {
+              cerr << "Cannot open list file: " << list_file << endl;
+              exit(EXIT_FAILURE);
+          }
+      }
+      istream& list = (list_file == "-") ? cin : list_stream;
+      string line;
+      while(getline(list, line))
+          if(line != "")
+              AddMovies(line, &movie_files);
+  }
+
+  if(validation_movie != "" && calibration_movie == "")
+  {
+      cerr << "-Q needs a calibration movie (-q)." << endl;
+      exit(EXIT_FAILURE);
+  }
+
+  if(workers != 1 && (socket_path != "" || validation_movie != ""))
+  {
+      cerr << "-W can't be used with -S or -Q." << endl;
+      exit(EXIT_FAILURE);
+  }
+
+  if(movie_files.empty() && socket_path == "" && validation_movie == "")
   {
       cerr << "No input movie file." << endl;
       PrintUsage(argv[0]);
       exit(EXIT_FAILURE);
   }
-  movie_file = argv[optind];
 
+  long long max_temp_bytes = max_temp_mb * 1048576;
 
-  //keep Caffe quiet
-  FLAGS_minloglevel = 3;
-  ::google::InitGoogleLogging(argv[0]);
+  //the second pass only reads the seconds it needs, there is no last
+  //frame to compare with
+  if(skip_threshold > 0 && sample_stride > 1)
+  {
+      cerr << "Warning: -z is ignored with -e" << endl;
+      skip_threshold = 0;
+  }
 
-  //create the classifier
-  Classifier classifier(model_def, model_weights, mean_file, label_file);
+  cv::Size input_size;
+  int input_channels = 0;
+  if(input_shape != "")
+  {
+      int n = sscanf(input_shape.c_str(), "%dx%dx%d", &input_size.width, &input_size.height,
+              &input_channels);
+      if(n < 2 || input_size.width <= 0 || input_size.height <= 0 || (n == 3 && input_channels <= 0))
+      {
+          cerr << "Input size should be WxH or WxHxC: " << input_shape << endl;
+          exit(EXIT_FAILURE);
+      }
+  }
+
+  //only ask about deleting originals when cutting a single movie
+  bool batch_mode = movie_files.size() > 1 || list_file != "";
+  if(batch_mode)
+      remove_original = false;
+
+
+  //everything besides the movie that changes its scores
+  uint64_t cache_key = HashFile(model_weights);
+  cache_key = HashFile(model_def, cache_key);
+  cache_key = HashFile(mean_file, cache_key);
+  ostringstream cache_settings;
+  cache_settings << backend << " fold=" << fold_layers << " skip=" << skip_threshold
+      << " stride=" << sample_stride;
+  if(input_shape != "")
+      cache_settings << " input=" << input_shape;
+  if(sample_stride > 1)
+      cache_settings << " near=" << min_score;  //picks the seconds of the second pass
+  cache_key = HashString(cache_settings.str(), cache_key);
+  //scores calibrated on a movie that can't be hashed can't be told apart
+  string score_directory = cache_directory;
+  if(calibration_movie != "" && !HashMovie(calibration_movie, &cache_key, cache_key))
+      score_directory = "";
+  ScoreCache cache(score_directory, cache_key);
+
+  vector<string> labels = ReadLabels(label_file);
+
+  //movies scored before with the same model and settings are only cut
+  vector<ScoreMatrix> cached(movie_files.size());
+  vector<bool> hit(movie_files.size(), false);
+  int hits = 0;
+  if(socket_path == "" && validation_movie == "")
+      for(int m=0; m<movie_files.size(); m++)
+          if(cache.Load(movie_files[m], labels, &cached[m]))
+          {
+              hit[m] = true;
+              hits++;
+          }
+  if(hits > 0)
+      cout << "Using cached scores for " << hits << "/" << movie_files.size() << " movies" << endl;
+
+  //split the movies between workers, each loading the model for itself.
+  //The parent only hands out the movies and waits.
+  WorkerPool pool;
+  if(workers != 1 && hits < movie_files.size() && movie_files.size() > 1)
+  {
+      vector<vector<int> > cores = WorkerCores(workers);
+      cout << "Starting " << cores.size() << " workers on cores";
+      for(int w=0; w < cores.size(); w++)
+          cout << " [" << CoreList(cores[w]) << "]";
+      cout << endl;
+
+      if(!pool.Fork(cores))
+      {
+          int failed = pool.Serve(movie_files.size());
+          if(failed > 0)
+          {
+              cerr << failed << " of the workers failed" << endl;
+              exit(EXIT_FAILURE);
+          }
+          return 0;
+      }
+
+      //one timings report per worker
+      if(report_file != "")
+      {
+          string ext = getFileExtension(report_file);
+          if(ext[0] != '.' || ext.find('/') != string::npos)
+              ext = "";
+          report_file = report_file.substr(0, report_file.size() - ext.size()) + ".worker" 
+              + to_string(pool.Worker()) + ext;
+      }
+  }
+
+  //threads for the cores we have, which in a worker are its own
+  if(preprocess_threads <= 0)
+      preprocess_threads = usableCores();
+  if(forward_threads <= 0)
+      forward_threads = preprocess_threads;
+
+  //and if that is all of them the model isn't even loaded
+  boost::shared_ptr<Classifier> classifier;
+  double frame_mb = 0;
+  if(hits < movie_files.size() || socket_path != "" || validation_movie != "")
+  {
+      //keep Caffe quiet
+      FLAGS_minloglevel = 3;
+      ::google::InitGoogleLogging(argv[0]);
+
+      //create the classifier
+      BackendOptions backend_options;
+      backend_options.name = backend;
+      backend_options.model_file = model_def;
+      backend_options.trained_file = model_weights;
+      backend_options.batch_size = batch_size;
+      backend_options.threads = forward_threads;
+      backend_options.fold_layers = fold_layers;
+      backend_options.int8 = calibration_movie != "";
+      backend_options.cpu = backend_options.int8;  //INT8 only runs there
+      backend_options.input_size = input_size;
+      backend_options.input_channels = input_channels;
+
+      if(max_memory_mb > 0)
+          frame_mb = FrameMB(movie_files, hit, decoders);
+
+      if(auto_tune)
+      {
+          //tune on the first movie that will be classified, the network
+          //gets what is left of the budget now
+          string tune_movie = "";
+          for(int m=0; m<movie_files.size() && tune_movie == ""; m++)
+              if(!hit[m])
+                  tune_movie = movie_files[m];
+          double tune_budget_mb = 0;
+          if(max_memory_mb > 0)
+              tune_budget_mb = max(1.0, max_memory_mb - residentMemoryMB());
+          TuneSettings tuned = TuneClassifier(backend_options, mean_file, label_file, 
+                  tune_movie, cache_directory, tune_budget_mb);
+          preprocess_threads = tuned.preprocess_threads;
+          backend_options.batch_size = tuned.batch_size;
+          backend_options.threads = tuned.forward_threads;
+      }
+      classifier = FitClassifier(&backend_options, mean_file, label_file, preprocess_threads, 
+              frame_mb, max_memory_mb);
+      batch_size = backend_options.batch_size;
+
+      if(calibration_movie != "")
+      {
+          //the sampled frames are full size
+          int max_frames = INT_MAX;
+          if(max_memory_mb > 0)
+              max_frames = max(1, (int)((max_memory_mb - residentMemoryMB()) / (2 * frame_mb)));
+          CalibrateInt8(classifier.get(), calibration_movie, validation_movie, max_frames);
+      }
+
+      //serve jobs from clients until killed
+      if(socket_path != "")
+      {
+          RunServer(socket_path, classifier.get(), batch_size, temp_directory);
+          return 0;
+      }
+  }
 
   if(set_all_but_other)
-        target_list = allExceptOther(classifier.labels_);
+        target_list = allExceptOther(labels);
 
   //print targets
   if(auto_tag)
@@ -485,104 +838,209 @@ int main(int argc, char** argv)
       cout << "]" << endl;
   }
 
-  
-  global_ffmpeg_done = MAX_IMG_IDX;
-  boost::thread first(CreateScreenShots, movie_file, screenshot_directory);
-  //first.join();  //uncomment to make predictions wait for screenshots
-    
-  int epoch = 0;
-  bool no_more = false;
-  ScoreList score_list;
+  vector<int> target_ints;
+  for(int i=0; i<target_list.size(); i++)
+      target_ints.push_back(IndexOf(target_list[i],labels));
 
-  //loop till all screenshots have been
-  //extracted and classified
-  while(true)
-  {
-    vector<cv::Mat> imgs;
-    //fill a batch with screenshots to classify
-    for( int i=0; i < batch_size; i++ )
+  //a movie that fails is reported and counted, the others go on
+  int failed = 0;
+  auto end_run = [&]() {
+    EndOfRun(report_file);
+    if(failed == 0)
+        return 0;
+    cerr << failed << " of " << movie_files.size() << " movies failed" << endl;
+    return EXIT_FAILURE;
+  };
+
+  //Either create a file out the cuts for all targets
+  //or make the cuts from the input list
+  auto cut_movie = [&](const string& movie_file, const ScoreMatrix& score_list) {
+    CutList cuts;
+    string error;
+    bool ok;
+    if(auto_tag)
+    {
+      ok = TagTargets( score_list, movie_file, output_directory, labels,
+              labels.size(), min_cut, max_gap, min_score ,min_coverage, &cuts, &error);
+    }
+    else
     {
-        
-        int idx = epoch * batch_size + i + 1;
+      //make the cuts based on the predictions
+      ok = CutMovie( score_list, movie_file, target_ints, output_directory, temp_directory, 
+              labels.size(), min_cut, max_gap, min_score, 
+              min_coverage, do_concat, remove_original, max_temp_bytes, &cuts, &error );
+    }
+    if(!ok)
+    {
+      cerr << "Error cutting " << movie_file << ": " << error << endl;
+      failed++;
+    }
+  };
 
-        //print some progress updates
-        if(idx % report_interval == 0)
-        {
-            if(global_ffmpeg_done < MAX_IMG_IDX)
-                cout << PrettyTime(idx) << "/" << PrettyTime(global_ffmpeg_done) << endl;
-            else
-                cout << PrettyTime(idx) << endl;
-        }
+  if(!classifier)
+  {
+      for(int m=0; m<movie_files.size(); m++)
+      {
+          if(batch_mode)
+              cout << endl << "Movie [" << m+1 << "/" << movie_files.size() << "] " 
+                  << movie_files[m] << endl;
+          cut_movie(movie_files[m], cached[m]);
+      }
+      return end_run();
+  }
 
-        string the_image = "img_" + FormatFileNumber(idx) + ".jpg";
-        string the_image_path = screenshot_directory + the_image;
 
-        //wait for screenshots from ffmpeg thread
-        while( !FileExists( the_image_path ) )
-        {
-            //if ffmpeg is done getting screenshots quit waiting
-            if(idx >= global_ffmpeg_done)
+  //the frames of the movies being decoded go into shared batches, so
+  //short clips and the end of a movie don't leave the batch half empty.
+  //Each movie is cut as soon as its last frame is scored.
+  int queue_size = 2 * batch_size;
+  if(max_memory_mb > 0)
+  {
+      //fewer frames queued first, as long as they still fill a batch,
+      //then fewer movies at once, then less than a batch
+      double input_mb = classifier->InputSize() * sizeof(float) / 1048576.0;
+      double network_mb = residentMemoryMB();
+      auto over = [&]() {
+          return network_mb + PipelineMB(batch_size, queue_size, decoders, frame_mb, input_mb)
+              > max_memory_mb;
+      };
+      while(queue_size > batch_size && over())
+          queue_size--;
+      while(decoders > 1 && over())
+          decoders--;
+      while(queue_size > 1 && over())
+          queue_size--;
+
+      double need_mb = network_mb + PipelineMB(batch_size, queue_size, decoders, frame_mb, input_mb);
+      cout << "Memory budget " << (int)max_memory_mb << " MB: batch size " << batch_size << ", "
+          << decoders << " movies decoding, " << queue_size << " frames queued (about " 
+          << (int)need_mb << " MB)" << endl;
+      if(over())
+          cerr << "Warning: the run needs more than --max-memory even so" << endl;
+  }
+
+  BatchScheduler scheduler(classifier.get(), batch_size, queue_size, -1);
+  Slots decoding(decoders);
+  Slots alive(2 * decoders);
+  boost::mutex finish_mutex;
+
+  auto run_movie = [&](int m) {
+    string movie_file = movie_files[m];
+    string prefix = "";
+    if(batch_mode)
+        prefix = "[" + to_string(m+1) + "/" + to_string(movie_files.size()) + "] ";
+
+    ScoreJob job(labels.size());
+    FrameGrabber grabber(hit[m] ? "" : movie_file);
+    FrameGate gate(skip_threshold);
+    boost::function<void(int)> progress = [&](int seconds) {
+        PrintProgress(prefix, seconds, grabber.Duration(), report_interval);
+    };
+    ScoreMatrix score_list;
+    int classified = -1;
+
+    //cut the pieces as the seconds come out of the network
+    boost::scoped_ptr<StreamingCut> stream;
+    boost::thread stream_thread;
+    if(stream_cuts && !auto_tag && !hit[m] && sample_stride == 1 && grabber.IsOpened())
+    {
+        stream.reset(new StreamingCut(movie_file, target_ints, output_directory, temp_directory,
+                labels.size(), min_cut, max_gap, min_score, min_coverage, do_concat, 
+                remove_original, max_temp_bytes, grabber.Duration()));
+        stream_thread = boost::thread([&]() {
+            ScoreMatrix rows(labels.size());
+            int done = 0;
+            while(job.WaitRows(&rows))
             {
-                no_more = true;
-                break;
+                stream->AddRows(rows.row(done), rows.rows() - done);
+                done = rows.rows();
             }
-            cout << " Waiting for: " + the_image_path << endl;
-            sleep(sleep_time);
-        }
+        });
+    }
 
-        if(!no_more)
+    bool adaptive = !hit[m] && grabber.IsOpened() && sample_stride > 1;
+    bool scored = true;
+    if(hit[m] || !grabber.IsOpened())
+        scheduler.Finish(&job, 0);
+    else if(adaptive)
+        scored = ScoreMovieAdaptive(&scheduler, &grabber, labels.size(),
+                sample_stride, min_score, progress, &score_list, &classified);
+    else
+        SubmitMovie(&scheduler, &grabber, &job, &gate, progress);
+    decoding.Release();
+
+    if(hit[m])
+        score_list = cached[m];
+    else if(!adaptive)
+        score_list = job.Wait();
+    if(stream)
+        stream_thread.join();
+
+    if(grabber.IsOpened() && scored)
+        cache.Save(movie_file, labels, score_list);
+
+    //one movie reports and cuts at a time, which also guards failed
+    boost::unique_lock<boost::mutex> lock(finish_mutex);
+    if(batch_mode)
+        cout << endl << "Movie " << prefix << movie_file << endl;
+    if(classified >= 0 && score_list.rows() > 0)
+        cout << "Classified " << classified << "/" << score_list.rows() << " seconds ("
+            << 100 * classified / score_list.rows() << "%)" << endl;
+    if(gate.Skipped() > 0)
+        cout << "Reused the scores of similar frames for " << gate.Skipped() << "/" 
+            << gate.Seen() << " seconds (" << 100 * gate.Skipped() / gate.Seen() << "%)" << endl;
+
+    if(!hit[m] && !grabber.IsOpened())
+    {
+        cerr << "Error opening movie: " << movie_file << endl;
+        failed++;
+    }
+    else if(!scored)
+    {
+        cerr << "Error: can't read back the seconds to refine in " << movie_file 
+            << ", -e needs a movie that can be read twice" << endl;
+        failed++;
+    }
+    else if(stream)
+    {
+        string error;
+        if(!stream->Finish(&error))
         {
-            cv::Mat img = cv::imread(the_image_path,-1);
-            CHECK(!img.empty()) << "Unable to decode image " << the_image_path;
-            imgs.push_back(img);
+            cerr << "Error cutting " << movie_file << ": " << error << endl;
+            failed++;
         }
-        else
-            break;
     }
-
-    //don't try to classify an empty batch
-    if(imgs.size() == 0)
-        break;
-
-    //perform classification
-    ScoreList ordered_preds = classifier.Classify(imgs);
-    for( size_t i=0; i < ordered_preds.size(); ++i) 
-        score_list.push_back(ordered_preds[i]);
-
-    if(no_more)
-        break;
-
-    epoch += 1;
-  }
-
-  //Either create a file out the cuts for all targets
-  //or make the cuts from the input list
-  if(auto_tag)
-  {
-    TagTargets( score_list, movie_file, output_directory, classifier.labels_,
-            classifier.labels_.size(), min_cut, max_gap, min_score ,min_coverage);
-  }
-  else
-  {
-    //make the cuts based on the predictions
-    vector<int> target_ints;
-    for(int i=0; i<target_list.size(); i++)
+    else
+        cut_movie(movie_file, score_list);
+    alive.Release();
+  };
+
+  //the movies in order, or as the parent hands them to this worker
+  int next_movie = 0;
+  auto take_movie = [&]() {
+    if(pool.Worker() >= 0)
+        return pool.NextJob();
+    return next_movie < movie_files.size() ? next_movie++ : -1;
+  };
+
+  //start a few movies at a time, the network runs on this thread
+  boost::thread dispatcher([&]() {
+    boost::thread_group movies;
+    while(true)
     {
-      int target_idx = IndexOf(target_list[i],classifier.labels_);
-      target_ints.push_back(target_idx);
+        alive.Acquire();
+        decoding.Acquire();
+        int m = take_movie();
+        if(m < 0)
+            break;
+        scheduler.Begin();
+        movies.create_thread(boost::bind<void>(run_movie, m));
     }
-    CutMovie( score_list, movie_file, target_ints, output_directory, temp_directory, 
-            classifier.labels_.size(), min_cut, max_gap, min_score, 
-            min_coverage, do_concat, remove_original );
-  }
-
-  //clean up screenshots
-  string clean_cmd = "rm -rf " + screenshot_directory;
-  if(system(clean_cmd.c_str()))
-  {
-    cerr << "Error cleaning up temporary files: " << clean_cmd << endl;
-    exit(EXIT_FAILURE);
-  }
+    movies.join_all();
+    scheduler.Stop();
+  });
 
+  scheduler.Run();
+  dispatcher.join();
+  return end_run();
 }
-
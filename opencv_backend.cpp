@@ -0,0 +1,97 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifdef USE_OPENCV_DNN
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "opencv_backend.hpp"
+
+
+using namespace std;
+
+/* cv::setNumThreads sets the pool of the whole process, which decoding,
+ * the resize and cvtColor of preprocessing and the frame gate use too.
+ * The dnn module has no setting of its own, so the network gets its
+ * threads only while it runs and the old count is put back after. */
+class NetThreads
+{
+ public:
+  explicit NetThreads(int threads) : old_(cv::getNumThreads())
+  {
+    cv::setNumThreads(threads);
+  }
+  ~NetThreads() { cv::setNumThreads(old_); }
+
+ private:
+  int old_;
+};
+
+OpenCVBackend::OpenCVBackend(const BackendOptions& options)
+    : input_geometry_(options.input_size), num_channels_(options.input_channels),
+      threads_(options.threads)
+{
+  if (input_geometry_.area() <= 0)
+    input_geometry_ = cv::Size(224, 224);
+  if (num_channels_ <= 0)
+    num_channels_ = 3;
+
+  /* An .onnx model is one file, readNet ignores the definition then. */
+  net_ = cv::dnn::readNet(options.trained_file, options.model_file);
+  if (net_.empty())
+  {
+    cerr << "OpenCV can't read the model: " << options.trained_file << endl;
+    exit(EXIT_FAILURE);
+  }
+  net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+  net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+  /* Run a blank image through to find the number of outputs. This is
+   * where a model wanting another input size fails. */
+  vector<float> blank(NumChannels() * InputGeometry().area(), 0);
+  int shape[] = {1, NumChannels(), InputGeometry().height, InputGeometry().width};
+  num_outputs_ = 0;
+  try
+  {
+    NetThreads threads(threads_);
+    net_.setInput(cv::Mat(4, shape, CV_32F, &blank[0]));
+    num_outputs_ = net_.forward().total();
+  }
+  catch (const cv::Exception& e)
+  {
+    cerr << e.what() << endl;
+  }
+  if (num_outputs_ <= 0)
+  {
+    cerr << "OpenCV can't run the model on " << InputGeometry().width << "x"
+         << InputGeometry().height << "x" << NumChannels()
+         << " input, give its input size with -I" << endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void OpenCVBackend::Forward(float* input, int num, float* scores)
+{
+  int shape[] = {num, NumChannels(), InputGeometry().height, InputGeometry().width};
+  cv::Mat output;
+  {
+    NetThreads threads(threads_);
+    net_.setInput(cv::Mat(4, shape, CV_32F, input));
+    output = net_.forward();
+  }
+  if (output.total() != (size_t)num * num_outputs_)
+  {
+    cerr << "OpenCV returned " << output.total() << " scores for " << num
+         << " images instead of " << num_outputs_ << " each" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  const float* data = output.ptr<float>();
+  std::copy(data, data + num * num_outputs_, scores);
+}
+
+#endif
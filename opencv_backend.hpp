@@ -0,0 +1,40 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef OPENCV_BACKEND_HPP
+#define OPENCV_BACKEND_HPP
+
+#ifdef USE_OPENCV_DNN
+
+#include <opencv2/dnn.hpp>
+#include "inference_backend.hpp"
+
+/* The network run on the CPU by OpenCV's dnn module, from a Caffe model
+ * or a single .onnx file. Needs OpenCV 3.4 or later. The dnn module
+ * doesn't say what input it expects, so it comes from the options, or is
+ * taken to be 224x224 BGR like the bundled model. */
+class OpenCVBackend : public InferenceBackend
+{
+ public:
+  explicit OpenCVBackend(const BackendOptions& options);
+
+  virtual const char* Name() const { return "opencv"; }
+
+  virtual cv::Size InputGeometry() const { return input_geometry_; }
+  virtual int NumChannels() const { return num_channels_; }
+  virtual int NumOutputs() const { return num_outputs_; }
+
+  virtual void Forward(float* input, int num, float* scores);
+
+ private:
+  cv::dnn::Net net_;
+  cv::Size input_geometry_;
+  int num_channels_;
+  int num_outputs_;
+  int threads_;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "preprocess.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PACK_X86
+#include <immintrin.h>
+#endif
+
+//scalar version of one row, also handles the tail of the SIMD rows
+static inline void PackRowScalar(const unsigned char* src, int x, int width,
+        int channels, const float* mean, float* dst, size_t plane)
+{
+    for( ; x < width; x++)
+        for(int c=0; c < channels; c++)
+            dst[c * plane + x] = (float)src[x * channels + c] - mean[c];
+}
+
+void PackPlanarFloatScalar(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst)
+{
+    size_t plane = (size_t)width * height;
+    for(int y=0; y < height; y++)
+        PackRowScalar(src + y * src_step, 0, width, channels, mean,
+                dst + (size_t)y * width, plane);
+}
+
+#ifdef PACK_X86
+
+//pshufb masks that pull channel c of 16 BGR pixels (48 bytes)
+//out of each of the three 16 byte loads
+struct DeinterleaveMasks
+{
+    unsigned char m[3][3][16];  //[channel][load][lane]
+
+    DeinterleaveMasks()
+    {
+        for(int c=0; c < 3; c++)
+            for(int p=0; p < 3; p++)
+                for(int j=0; j < 16; j++)
+                {
+                    int k = 3 * j + c - 16 * p;
+                    m[c][p][j] = (k >= 0 && k < 16) ? k : 0x80;
+                }
+    }
+};
+
+static const DeinterleaveMasks kMasks;
+
+__attribute__((target("ssse3")))
+static inline __m128i Deinterleave(__m128i a, __m128i b, __m128i c, int ch)
+{
+    __m128i va = _mm_shuffle_epi8(a, _mm_loadu_si128((const __m128i*)kMasks.m[ch][0]));
+    __m128i vb = _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i*)kMasks.m[ch][1]));
+    __m128i vc = _mm_shuffle_epi8(c, _mm_loadu_si128((const __m128i*)kMasks.m[ch][2]));
+    return _mm_or_si128(_mm_or_si128(va, vb), vc);
+}
+
+//16 bytes to 16 floats minus the mean, 4 at a time
+__attribute__((target("ssse3")))
+static inline void Store16SSE(__m128i v, __m128 mean, float* dst)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_ps(dst,      _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), mean));
+    _mm_storeu_ps(dst + 4,  _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), mean));
+    _mm_storeu_ps(dst + 8,  _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), mean));
+    _mm_storeu_ps(dst + 12, _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), mean));
+}
+
+//16 bytes to 16 floats minus the mean, 8 at a time
+__attribute__((target("avx2")))
+static inline void Store16AVX2(__m128i v, __m256 mean, float* dst)
+{
+    __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+    __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    _mm256_storeu_ps(dst,     _mm256_sub_ps(f0, mean));
+    _mm256_storeu_ps(dst + 8, _mm256_sub_ps(f1, mean));
+}
+
+__attribute__((target("ssse3")))
+static void PackPlanarFloatSSSE3(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst)
+{
+    size_t plane = (size_t)width * height;
+    __m128 m[3];
+    for(int c=0; c < channels; c++)
+        m[c] = _mm_set1_ps(mean[c]);
+
+    for(int y=0; y < height; y++)
+    {
+        const unsigned char* s = src + y * src_step;
+        float* d = dst + (size_t)y * width;
+        int x = 0;
+        if(channels == 3)
+        {
+            for( ; x + 16 <= width; x += 16)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(s + 3 * x));
+                __m128i b = _mm_loadu_si128((const __m128i*)(s + 3 * x + 16));
+                __m128i c = _mm_loadu_si128((const __m128i*)(s + 3 * x + 32));
+                for(int ch=0; ch < 3; ch++)
+                    Store16SSE(Deinterleave(a, b, c, ch), m[ch], d + ch * plane + x);
+            }
+        }
+        else if(channels == 1)
+        {
+            for( ; x + 16 <= width; x += 16)
+                Store16SSE(_mm_loadu_si128((const __m128i*)(s + x)), m[0], d + x);
+        }
+        PackRowScalar(s, x, width, channels, mean, d, plane);
+    }
+}
+
+__attribute__((target("avx2")))
+static void PackPlanarFloatAVX2(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst)
+{
+    size_t plane = (size_t)width * height;
+    __m256 m[3];
+    for(int c=0; c < channels; c++)
+        m[c] = _mm256_set1_ps(mean[c]);
+
+    for(int y=0; y < height; y++)
+    {
+        const unsigned char* s = src + y * src_step;
+        float* d = dst + (size_t)y * width;
+        int x = 0;
+        if(channels == 3)
+        {
+            for( ; x + 16 <= width; x += 16)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(s + 3 * x));
+                __m128i b = _mm_loadu_si128((const __m128i*)(s + 3 * x + 16));
+                __m128i c = _mm_loadu_si128((const __m128i*)(s + 3 * x + 32));
+                for(int ch=0; ch < 3; ch++)
+                    Store16AVX2(Deinterleave(a, b, c, ch), m[ch], d + ch * plane + x);
+            }
+        }
+        else if(channels == 1)
+        {
+            for( ; x + 16 <= width; x += 16)
+                Store16AVX2(_mm_loadu_si128((const __m128i*)(s + x)), m[0], d + x);
+        }
+        PackRowScalar(s, x, width, channels, mean, d, plane);
+    }
+}
+
+#endif
+
+typedef void (*PackFn)(const unsigned char*, size_t, int, int, int, const float*, float*);
+
+static PackFn ChooseKernel(const char** name)
+{
+#ifdef PACK_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return PackPlanarFloatAVX2;
+    }
+    if(__builtin_cpu_supports("ssse3"))
+    {
+        *name = "ssse3";
+        return PackPlanarFloatSSSE3;
+    }
+#endif
+    *name = "scalar";
+    return PackPlanarFloatScalar;
+}
+
+static const char* kernel_name = "";
+static const PackFn pack_kernel = ChooseKernel(&kernel_name);
+
+void PackPlanarFloat(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst)
+{
+    pack_kernel(src, src_step, width, height, channels, mean, dst);
+}
+
+const char* PackPlanarFloatKernel()
+{
+    return kernel_name;
+}
+
+bool PreprocessFrame(const cv::Mat& img, cv::Size size, int channels, const float* mean,
+        float* dst)
+{
+    thread_local cv::Mat converted;
+    thread_local cv::Mat resized;
+
+    //convert to the channels of the network
+    int code = -1;
+    if(img.channels() == 3 && channels == 1)
+        code = cv::COLOR_BGR2GRAY;
+    else if(img.channels() == 4 && channels == 1)
+        code = cv::COLOR_BGRA2GRAY;
+    else if(img.channels() == 4 && channels == 3)
+        code = cv::COLOR_BGRA2BGR;
+    else if(img.channels() == 1 && channels == 3)
+        code = cv::COLOR_GRAY2BGR;
+
+    const cv::Mat* sample = &img;
+    if(code >= 0)
+    {
+        cv::cvtColor(img, converted, code);
+        sample = &converted;
+    }
+
+    if(sample->size() != size)
+    {
+        cv::resize(*sample, resized, size);
+        sample = &resized;
+    }
+
+    if(sample->depth() != CV_8U)
+        return false;
+    PackPlanarFloat(sample->data, sample->step, size.width, size.height, channels, mean, dst);
+    return true;
+}
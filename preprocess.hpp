@@ -0,0 +1,34 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef PREPROCESS_HPP
+#define PREPROCESS_HPP
+
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+
+//Convert an interleaved 8 bit image with 1 or 3 channels into planar
+//32 bit float with the per channel mean subtracted, in one pass.
+//Channel c of pixel (x,y) goes to dst[c*width*height + y*width + x],
+//which is the layout of one image in the Caffe input blob.
+//Uses AVX2 or SSSE3 when the cpu has them.
+void PackPlanarFloat(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst);
+
+//same thing without SIMD, for reference
+void PackPlanarFloatScalar(const unsigned char* src, size_t src_step, int width, int height,
+        int channels, const float* mean, float* dst);
+
+//name of the kernel PackPlanarFloat uses on this machine
+const char* PackPlanarFloatKernel();
+
+//A frame with 1, 3 or 4 channels to the input of a network taking size
+//images with channels channels: converts the color, resizes and packs it
+//with PackPlanarFloat into dst. The intermediate images are kept per
+//thread. This is all of Classifier::Preprocess. False if the frame isn't
+//8 bit.
+bool PreprocessFrame(const cv::Mat& img, cv::Size size, int channels, const float* mean,
+        float* dst);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+using namespace std;
+
+JobRequest::JobRequest()
+    : mode("cut"), all_but_other(false), output_dir(""), min_cut(4), max_gap(2),
+      min_score(0.5), min_coverage(0.4), do_concat(true), skip_threshold(0),
+      sample_stride(1)
+{
+    targets.push_back("blowjob_handjob");
+}
+
+bool LineSocket::ReadLine(string* line)
+{
+    while(true)
+    {
+        size_t end = buffer_.find('\n');
+        if(end != string::npos)
+        {
+            *line = buffer_.substr(0, end);
+            buffer_.erase(0, end + 1);
+            return true;
+        }
+
+        char chunk[4096];
+        ssize_t n = read(fd_, chunk, sizeof(chunk));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        buffer_.append(chunk, n);
+    }
+}
+
+bool LineSocket::Write(const string& data)
+{
+    size_t done = 0;
+    while(done < data.size())
+    {
+        ssize_t n = write(fd_, data.data() + done, data.size() - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+bool WriteRequest(LineSocket* sock, const JobRequest& request)
+{
+    ostringstream out;
+    out << "movie " << request.movie_file << '\n';
+    out << "mode " << request.mode << '\n';
+    out << "targets ";
+    for(int i=0; i < request.targets.size(); i++)
+        out << (i ? "," : "") << request.targets[i];
+    out << '\n';
+    out << "all_but_other " << request.all_but_other << '\n';
+    if(request.output_dir != "")
+        out << "output_dir " << request.output_dir << '\n';
+    out << "min_cut " << request.min_cut << '\n';
+    out << "max_gap " << request.max_gap << '\n';
+    out << "min_score " << request.min_score << '\n';
+    out << "min_coverage " << request.min_coverage << '\n';
+    out << "concat " << request.do_concat << '\n';
+    out << "skip_threshold " << request.skip_threshold << '\n';
+    out << "sample_stride " << request.sample_stride << '\n';
+    out << '\n';
+    return sock->Write(out.str());
+}
+
+bool ReadRequest(LineSocket* sock, JobRequest* request, string* error)
+{
+    string line;
+    while(sock->ReadLine(&line))
+    {
+        if(line == "")
+        {
+            if(request->movie_file == "")
+            {
+                *error = "no movie given";
+                return false;
+            }
+            return true;
+        }
+
+        size_t space = line.find(' ');
+        string key = line.substr(0, space);
+        string value = (space == string::npos) ? "" : line.substr(space + 1);
+
+        if(key == "movie")
+            request->movie_file = value;
+        else if(key == "mode")
+            request->mode = value;
+        else if(key == "targets")
+        {
+            request->targets.clear();
+            stringstream ss(value);
+            string item;
+            while(getline(ss, item, ','))
+                request->targets.push_back(item);
+        }
+        else if(key == "all_but_other")
+            request->all_but_other = atoi(value.c_str());
+        else if(key == "output_dir")
+            request->output_dir = value;
+        else if(key == "min_cut")
+            request->min_cut = atoi(value.c_str());
+        else if(key == "max_gap")
+            request->max_gap = atoi(value.c_str());
+        else if(key == "min_score")
+            request->min_score = atof(value.c_str());
+        else if(key == "min_coverage")
+            request->min_coverage = atof(value.c_str());
+        else if(key == "concat")
+            request->do_concat = atoi(value.c_str());
+        else if(key == "skip_threshold")
+            request->skip_threshold = atof(value.c_str());
+        else if(key == "sample_stride")
+            request->sample_stride = max(1, atoi(value.c_str()));
+        else
+        {
+            *error = "unknown setting: " + key;
+            return false;
+        }
+    }
+
+    *error = "connection closed";
+    return false;
+}
+
+static bool FillAddress(const string& socket_path, struct sockaddr_un* addr)
+{
+    if(socket_path.size() >= sizeof(addr->sun_path))
+        return false;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, socket_path.c_str(), sizeof(addr->sun_path) - 1);
+    return true;
+}
+
+int ConnectSocket(const string& socket_path)
+{
+    struct sockaddr_un addr;
+    if(!FillAddress(socket_path, &addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ListenSocket(const string& socket_path)
+{
+    struct sockaddr_un addr;
+    if(!FillAddress(socket_path, &addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+
+    bool bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    if(!bound && errno == EADDRINUSE)
+    {
+        //the socket file is either left over from an earlier server, or
+        //a server is still answering on it and must be left alone
+        int other = ConnectSocket(socket_path);
+        if(other >= 0)
+            close(other);
+        else if(unlink(socket_path.c_str()) == 0)
+            bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    if(!bound || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,64 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Jobs for the classification server. The client sends one
+//"key value" line per setting and an empty line to finish.
+//The server answers with lines of
+//   labels <label>,<label>,...
+//   seconds <n>
+//   skipped <n>                                      (seconds that reused scores)
+//   row <second> <score>,<score>,...                 (mode scores)
+//   cut <label> <start> <end> <score> <coverage>     (mode tag and cut)
+//and a last line of "ok" or "error <message>".
+
+static const char* const kDefaultSocket = "/tmp/miles-deep.sock";
+
+struct JobRequest
+{
+    JobRequest();
+
+    string movie_file;
+    string mode;                //cut, tag or scores
+    vector<string> targets;
+    bool all_but_other;
+    string output_dir;
+    int min_cut;
+    int max_gap;
+    float min_score;
+    float min_coverage;
+    bool do_concat;
+    double skip_threshold;      //see FrameGate
+    int sample_stride;          //see ScoreMovieAdaptive
+};
+
+//buffered line reading and writing on a socket
+class LineSocket
+{
+ public:
+    explicit LineSocket(int fd) : fd_(fd) {}
+
+    bool ReadLine(string* line);
+    bool Write(const string& data);
+
+ private:
+    int fd_;
+    string buffer_;
+};
+
+bool WriteRequest(LineSocket* sock, const JobRequest& request);
+bool ReadRequest(LineSocket* sock, JobRequest* request, string* error);
+
+int ConnectSocket(const string& socket_path);
+//-1 if it can't listen, also when another server is answering on the socket
+int ListenSocket(const string& socket_path);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifdef USE_LIBAV
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+}
+
+#include "remux.hpp"
+
+using namespace std;
+
+static string AvError(const string& what, int err)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(err, buf, sizeof(buf));
+    return what + ": " + buf;
+}
+
+//closes everything however RemuxCuts returns
+class RemuxContext
+{
+ public:
+    RemuxContext() : in(NULL), out(NULL), packet(av_packet_alloc()) {}
+
+    ~RemuxContext() { Close(); }
+
+    void Close()
+    {
+        av_packet_free(&packet);
+        if(out)
+        {
+            if(!(out->oformat->flags & AVFMT_NOFILE))
+                avio_closep(&out->pb);
+            avformat_free_context(out);
+            out = NULL;
+        }
+        if(in)
+            avformat_close_input(&in);
+    }
+
+    AVFormatContext* in;
+    AVFormatContext* out;
+    AVPacket* packet;
+};
+
+//copy one cut, out_start is where it starts in the output and is moved
+//to its end (both in AV_TIME_BASE units)
+static bool RemuxCut(RemuxContext* ctx, const vector<int>& stream_map, int ref_stream,
+        const Cut& cut, int64_t* out_start, vector<int64_t>* last_dts, string* error)
+{
+    AVFormatContext* in = ctx->in;
+    AVPacket* pkt = ctx->packet;
+    int64_t in_start = in->start_time != AV_NOPTS_VALUE ? in->start_time : 0;
+    int64_t cut_start = (int64_t)cut.s * AV_TIME_BASE;
+    int64_t cut_end = (int64_t)cut.e * AV_TIME_BASE;
+
+    //lands on the keyframe at or before the start
+    int ret = avformat_seek_file(in, -1, INT64_MIN, in_start + cut_start, in_start + cut_start, 0);
+    if(ret < 0)
+    {
+        *error = AvError("seek", ret);
+        return false;
+    }
+
+    //times relative to the start of the movie, AV_TIME_BASE units
+    int64_t seg_start = AV_NOPTS_VALUE;
+    int64_t seg_end = AV_NOPTS_VALUE;
+    while((ret = av_read_frame(in, pkt)) >= 0)
+    {
+        int index = pkt->stream_index;
+        AVStream* ist = in->streams[index];
+        int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if(stream_map[index] < 0 || ts == AV_NOPTS_VALUE)
+        {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        int64_t t = av_rescale_q(ts, ist->time_base, AV_TIME_BASE_Q) - in_start;
+        int64_t decode_t = pkt->dts != AV_NOPTS_VALUE ?
+            av_rescale_q(pkt->dts, ist->time_base, AV_TIME_BASE_Q) - in_start : t;
+
+        //the cut begins with the first keyframe of the reference stream,
+        //the other streams join from there
+        if(seg_start == AV_NOPTS_VALUE)
+        {
+            if(index != ref_stream || !(pkt->flags & AV_PKT_FLAG_KEY))
+            {
+                av_packet_unref(pkt);
+                continue;
+            }
+            seg_start = t;
+            seg_end = t;
+        }
+
+        if(index == ref_stream && decode_t >= cut_end)
+        {
+            av_packet_unref(pkt);
+            break;
+        }
+        if(t >= cut_end || (index != ref_stream && t < seg_start))
+        {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        int64_t duration = av_rescale_q(pkt->duration, ist->time_base, AV_TIME_BASE_Q);
+        seg_end = max(seg_end, t + duration);
+
+        //move the packet to where the cut goes in the output
+        int64_t shift = av_rescale_q(*out_start - seg_start - in_start, AV_TIME_BASE_Q,
+                ist->time_base);
+        if(pkt->pts != AV_NOPTS_VALUE)
+            pkt->pts += shift;
+        if(pkt->dts != AV_NOPTS_VALUE)
+            pkt->dts += shift;
+
+        AVStream* ost = ctx->out->streams[stream_map[index]];
+        av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
+        pkt->stream_index = stream_map[index];
+        pkt->pos = -1;
+
+        //reordered frames at the seam can't go back in time
+        int64_t& last = (*last_dts)[stream_map[index]];
+        if(pkt->dts != AV_NOPTS_VALUE)
+        {
+            if(last != AV_NOPTS_VALUE && pkt->dts <= last)
+                pkt->dts = last + 1;
+            if(pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+                pkt->pts = pkt->dts;
+            last = pkt->dts;
+        }
+
+        ret = av_interleaved_write_frame(ctx->out, pkt);
+        if(ret < 0)
+        {
+            *error = AvError("write", ret);
+            return false;
+        }
+    }
+
+    if(ret < 0 && ret != AVERROR_EOF)
+    {
+        *error = AvError("read", ret);
+        return false;
+    }
+
+    if(seg_start != AV_NOPTS_VALUE)
+        *out_start += seg_end - seg_start;
+    return true;
+}
+
+static bool Remux(RemuxContext* ctx, const string& movie_file, const string& output_file,
+        const CutList& cuts, string* error)
+{
+    int ret = avformat_open_input(&ctx->in, movie_file.c_str(), NULL, NULL);
+    if(ret < 0)
+    {
+        *error = AvError("open " + movie_file, ret);
+        return false;
+    }
+    if((ret = avformat_find_stream_info(ctx->in, NULL)) < 0)
+    {
+        *error = AvError("stream info", ret);
+        return false;
+    }
+
+    ret = avformat_alloc_output_context2(&ctx->out, NULL, NULL, output_file.c_str());
+    if(ret < 0 || !ctx->out)
+    {
+        *error = AvError("output format", ret);
+        return false;
+    }
+
+    //video, audio and subtitles are copied as they are
+    AVFormatContext* in = ctx->in;
+    AVFormatContext* out = ctx->out;
+    vector<int> stream_map(in->nb_streams, -1);
+    int first_stream = -1;
+    for(int i=0; i < in->nb_streams; i++)
+    {
+        AVCodecParameters* par = in->streams[i]->codecpar;
+        if(par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO
+                && par->codec_type != AVMEDIA_TYPE_SUBTITLE)
+            continue;
+
+        AVStream* ost = avformat_new_stream(out, NULL);
+        if(!ost || avcodec_parameters_copy(ost->codecpar, par) < 0)
+        {
+            *error = "can't copy stream " + to_string(i);
+            return false;
+        }
+        ost->codecpar->codec_tag = 0;
+        ost->time_base = in->streams[i]->time_base;
+        stream_map[i] = ost->index;
+        if(first_stream < 0)
+            first_stream = i;
+    }
+    if(first_stream < 0)
+    {
+        *error = "no streams to copy";
+        return false;
+    }
+
+    int ref_stream = av_find_best_stream(in, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if(ref_stream < 0 || stream_map[ref_stream] < 0)
+        ref_stream = first_stream;
+
+    if(!(out->oformat->flags & AVFMT_NOFILE))
+    {
+        ret = avio_open(&out->pb, output_file.c_str(), AVIO_FLAG_WRITE);
+        if(ret < 0)
+        {
+            *error = AvError("open " + output_file, ret);
+            return false;
+        }
+    }
+    out->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+    if((ret = avformat_write_header(out, NULL)) < 0)
+    {
+        *error = AvError("write header", ret);
+        return false;
+    }
+
+    int64_t out_start = 0;
+    vector<int64_t> last_dts(out->nb_streams, AV_NOPTS_VALUE);
+    for(int i=0; i < cuts.size(); i++)
+        if(!RemuxCut(ctx, stream_map, ref_stream, cuts[i], &out_start, &last_dts, error))
+            return false;
+
+    if((ret = av_write_trailer(out)) < 0)
+    {
+        *error = AvError("write trailer", ret);
+        return false;
+    }
+    return true;
+}
+
+bool RemuxCuts(const string& movie_file, const string& output_file, const CutList& cuts,
+        string* error)
+{
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+    av_register_all();
+#endif
+    av_log_set_level(AV_LOG_ERROR);
+
+    RemuxContext ctx;
+    bool ok = Remux(&ctx, movie_file, output_file, cuts, error);
+
+    //don't leave half a movie behind
+    bool created = ctx.out && ctx.out->pb;
+    ctx.Close();
+    if(!ok && created)
+        remove(output_file.c_str());
+    return ok;
+}
+
+#endif
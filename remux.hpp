@@ -0,0 +1,26 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef REMUX_HPP
+#define REMUX_HPP
+
+#ifdef USE_LIBAV
+
+#include <string>
+#include "cut_movie.hpp"
+
+using namespace std;
+
+//Copy the packets inside the cuts from movie_file straight into one new
+//movie, without re-encoding or writing any pieces. Every cut starts at the
+//keyframe before it, like ffmpeg -ss before -i, and the timestamps are
+//shifted so the cuts follow each other. The container is picked from the
+//extension of output_file. On failure the output is removed and the reason
+//is put in error.
+bool RemuxCuts(const string& movie_file, const string& output_file, const CutList& cuts,
+        string* error);
+
+#endif
+
+#endif
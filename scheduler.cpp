@@ -0,0 +1,240 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "scheduler.hpp"
+#include "stats.hpp"
+
+using namespace std;
+
+//how often a short batch checks if it should stop waiting
+static const int kPollMs = 20;
+
+ScoreJob::ScoreJob(int num_labels)
+    : scores_(num_labels), ready_(0), scored_(0), total_(-1)
+{
+}
+
+void ScoreJob::Grow(int second)
+{
+    if(second >= scores_.rows())
+    {
+        scores_.Resize(second + 1);
+        sources_.resize(second + 1, -1);
+    }
+}
+
+//fill in the repeats whose source is final and move ready_ past them
+void ScoreJob::Advance()
+{
+    while(ready_ < sources_.size() && sources_[ready_] >= 0)
+    {
+        int source = sources_[ready_];
+        if(source != ready_)
+        {
+            copy(scores_.row(source), scores_.row(source) + scores_.cols(), 
+                    scores_.row(ready_));
+            sources_[ready_] = ready_;
+        }
+        ready_++;
+    }
+}
+
+void ScoreJob::SetRow(int second, const float* scores)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    Grow(second);
+    copy(scores, scores + scores_.cols(), scores_.row(second));
+    sources_[second] = second;
+    scored_++;
+    Advance();
+    changed_.notify_all();
+}
+
+void ScoreJob::Repeat(int second, int source)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    Grow(second);
+    sources_[second] = source;
+    Advance();
+    changed_.notify_all();
+}
+
+void ScoreJob::FramesDone(int total)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    total_ = total;
+    changed_.notify_all();
+}
+
+ScoreMatrix ScoreJob::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(!Done())
+        changed_.wait(lock);
+    return scores_;
+}
+
+bool ScoreJob::WaitRows(ScoreMatrix* rows)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(ready_ <= rows->rows() && !Done())
+        changed_.wait(lock);
+
+    //repeats are always of an earlier second, so once every frame
+    //is scored all of them are ready
+    if(ready_ <= rows->rows())
+        return false;
+    rows->AppendRows(scores_.row(rows->rows()), ready_ - rows->rows());
+    return true;
+}
+
+BatchScheduler::BatchScheduler(Classifier* classifier, int batch_size, int queue_size,
+        int wait_ms)
+    : classifier_(classifier), batch_size_(batch_size), wait_ms_(wait_ms),
+      queue_(queue_size), submitting_(0)
+{
+}
+
+void BatchScheduler::Begin()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    submitting_++;
+}
+
+bool BatchScheduler::Submit(ScoreJob* job, int second, const cv::Mat& img)
+{
+    //time blocked on a full queue, waiting for the network
+    StageTimer timer("submit");
+    TaggedFrame frame;
+    frame.job = job;
+    frame.second = second;
+    frame.img = img;
+    return queue_.Push(frame);
+}
+
+void BatchScheduler::Finish(ScoreJob* job, int total)
+{
+    job->FramesDone(total);
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    submitting_--;
+}
+
+void BatchScheduler::Stop()
+{
+    queue_.Close();
+}
+
+//wait for one frame, then keep taking frames up to a full batch for as
+//long as more are expected
+void BatchScheduler::FillBatch(Batch* batch)
+{
+    vector<cv::Mat>& imgs = batch->imgs;
+    imgs.clear();
+    batch->jobs.clear();
+    batch->seconds.clear();
+
+    TaggedFrame frame;
+    bool got = queue_.Pop(&frame);
+    RecordValue("queue_depth", queue_.Size());
+    int waited = 0;
+    while(got || !queue_.IsClosed())
+    {
+        if(got)
+        {
+            imgs.push_back(frame.img);
+            batch->jobs.push_back(frame.job);
+            batch->seconds.push_back(frame.second);
+            if(imgs.size() >= batch_size_)
+                break;
+            waited = 0;
+        }
+        else
+        {
+            //nothing came, send the short batch unless frames are on the way
+            waited += kPollMs;
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if(wait_ms_ >= 0 ? waited >= wait_ms_ : submitting_ == 0)
+                break;
+        }
+        got = queue_.Pop(&frame, kPollMs);
+    }
+
+    RecordValue("batch_size", imgs.size());
+    classifier_->Stage(imgs, &batch->staged);
+
+    //the frames aren't needed once staged, the vector keeps its room
+    imgs.clear();
+}
+
+//fill the batches handed back by the network thread until the frames
+//run out, which is passed on as an empty batch
+void BatchScheduler::StageBatches(BoundedQueue<Batch*>* free, BoundedQueue<Batch*>* staged)
+{
+    Batch* batch;
+    while(free->Pop(&batch))
+    {
+        FillBatch(batch);
+        staged->Push(batch);
+        if(batch->staged.num == 0)
+            break;
+    }
+}
+
+void BatchScheduler::Run()
+{
+    Batch batches[2];
+    int num_labels = classifier_->labels_.size();
+    vector<float> scores(batch_size_ * num_labels);
+
+    //batch N goes through the network while batch N+1 is collected and
+    //preprocessed into the other staging buffer by one thread that lives
+    //as long as this run. The two batches go back and forth between it
+    //and this thread.
+    BoundedQueue<Batch*> free(2), staged(2);
+    free.Push(&batches[0]);
+    free.Push(&batches[1]);
+    boost::thread stager(&BatchScheduler::StageBatches, this, &free, &staged);
+
+    Batch* batch;
+    while(staged.Pop(&batch) && batch->staged.num > 0)
+    {
+        classifier_->Classify(&batch->staged, &scores[0]);
+        for(int i=0; i < batch->staged.num; i++)
+            batch->jobs[i]->SetRow(batch->seconds[i], &scores[i * num_labels]);
+        free.Push(batch);
+    }
+
+    free.Close();
+    stager.join();
+}
+
+int SubmitMovie(BatchScheduler* scheduler, FrameGrabber* grabber, ScoreJob* job,
+        FrameGate* gate, const boost::function<void(int)>& progress)
+{
+    int seconds = 0;
+    int submitted = 0;
+    int last = -1;
+    cv::Mat frame;
+    while(grabber->Next(&frame))
+    {
+        //the gate never skips before it has a frame to compare with
+        if(gate->Skip(frame))
+            job->Repeat(seconds, last);
+        else
+        {
+            if(!scheduler->Submit(job, seconds, frame))
+                break;
+            last = seconds;
+            submitted++;
+        }
+        seconds++;
+        if(progress)
+            progress(seconds);
+    }
+    scheduler->Finish(job, submitted);
+    return seconds;
+}
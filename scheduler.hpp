@@ -0,0 +1,120 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <utility>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+#include "classifier.hpp"
+#include "cut_movie.hpp"
+#include "frame_gate.hpp"
+#include "frame_grabber.hpp"
+#include "frame_queue.hpp"
+
+using namespace std;
+
+//the scores of one movie, filled in by the scheduler as its frames
+//come out of the network
+class ScoreJob
+{
+ public:
+    explicit ScoreJob(int num_labels);
+
+    void SetRow(int second, const float* scores);
+
+    //second gets the same scores as source, an earlier second
+    void Repeat(int second, int source);
+
+    //no more frames will be submitted, total were
+    void FramesDone(int total);
+
+    //block until every submitted frame has been scored
+    ScoreMatrix Wait();
+
+    //block until the seconds after the ones already in rows are scored,
+    //and append them. Seconds become ready in order, once every one before
+    //them is. False when the movie is done and there is nothing new.
+    bool WaitRows(ScoreMatrix* rows);
+
+ private:
+    void Grow(int second);
+    void Advance();
+    bool Done() const { return total_ >= 0 && scored_ == total_; }
+
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    ScoreMatrix scores_;
+    vector<int> sources_;   //-1 not known yet, itself if scored, or the second it repeats
+    int ready_;             //every second before this is final
+    int scored_;
+    int total_;
+};
+
+//where a frame came from
+struct TaggedFrame
+{
+    ScoreJob* job;
+    int second;
+    cv::Mat img;
+};
+
+//Collects the frames of all the movies being classified into shared
+//batches. Any number of threads Submit frames, Run() is the only thread
+//touching the network and must be the thread that created the Classifier.
+//
+//A short batch only goes out after waiting wait_ms for more frames. With
+//wait_ms < 0 it waits until no movie is still submitting frames, so every
+//batch but the very last is full and the net never has to be reshaped.
+class BatchScheduler
+{
+ public:
+    BatchScheduler(Classifier* classifier, int batch_size, int queue_size,
+            int wait_ms);
+
+    //a movie is about to submit frames
+    void Begin();
+
+    //blocks while the queue is full, false once the scheduler is stopped
+    bool Submit(ScoreJob* job, int second, const cv::Mat& img);
+
+    //the movie submitted all of its total frames
+    void Finish(ScoreJob* job, int total);
+
+    //classify batches until Stop() is called and the queue is drained
+    void Run();
+
+    void Stop();
+
+ private:
+    struct Batch
+    {
+        StagedBatch staged;
+        vector<cv::Mat> imgs;
+        vector<ScoreJob*> jobs;
+        vector<int> seconds;
+    };
+
+    void FillBatch(Batch* batch);
+    void StageBatches(BoundedQueue<Batch*>* free, BoundedQueue<Batch*>* staged);
+
+    Classifier* classifier_;
+    int batch_size_;
+    int wait_ms_;
+    BoundedQueue<TaggedFrame> queue_;
+    boost::mutex mutex_;
+    int submitting_;
+};
+
+//Decode a movie and submit every second of it, except the ones the gate
+//says can repeat the last submitted second. Calls Finish on the job.
+//progress gets the number of seconds decoded so far after each one.
+//Returns the number of seconds in the movie.
+int SubmitMovie(BatchScheduler* scheduler, FrameGrabber* grabber, ScoreJob* job,
+        FrameGate* gate, const boost::function<void(int)>& progress);
+
+#endif
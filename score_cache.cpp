@@ -0,0 +1,200 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "score_cache.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+//bump when the file layout changes
+const char kCacheMagic[4] = {'M', 'D', 'S', 'C'};
+const uint32_t kCacheVersion = 1;
+
+//bytes hashed at each of the start, middle and end of a movie
+const size_t kMovieSample = 1 << 20;
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = seed;
+    for(size_t i=0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t HashString(const string& s, uint64_t seed)
+{
+    return HashBytes(s.data(), s.size(), seed);
+}
+
+uint64_t HashFile(const string& path, uint64_t seed)
+{
+    ifstream f(path.c_str(), ios::binary);
+    if(!f)
+        return 0;
+
+    vector<char> buf(kMovieSample);
+    uint64_t h = seed;
+    while(f.read(&buf[0], buf.size()) || f.gcount() > 0)
+        h = HashBytes(&buf[0], f.gcount(), h);
+    return h;
+}
+
+bool HashMovie(const string& path, uint64_t* hash, uint64_t seed)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    ifstream f(path.c_str(), ios::binary | ios::ate);
+    if(!f)
+        return false;
+
+    uint64_t size = f.tellg();
+    uint64_t h = HashBytes(&size, sizeof(size), seed);
+
+    uint64_t offsets[3] = {0, size / 2, size > kMovieSample ? size - kMovieSample : 0};
+    vector<char> buf(kMovieSample);
+    for(int i=0; i < 3; i++)
+    {
+        f.clear();
+        f.seekg(offsets[i]);
+        f.read(&buf[0], buf.size());
+        h = HashBytes(&buf[0], f.gcount(), h);
+    }
+    *hash = h;
+    return true;
+}
+
+string DefaultCacheDirectory()
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if(xdg && *xdg)
+        return string(xdg) + "/miles-deep";
+    const char* home = getenv("HOME");
+    if(home && *home)
+        return string(home) + "/.cache/miles-deep";
+    return "";
+}
+
+ScoreCache::ScoreCache(const string& dir, uint64_t key)
+    : dir_(dir), key_(key)
+{
+}
+
+bool ScoreCache::Path(const string& movie_file, string* path) const
+{
+    uint64_t hash;
+    if(!HashMovie(movie_file, &hash, key_))
+        return false;
+
+    //the key is part of the name so every model and setting
+    //gets its own entry instead of replacing the last one
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx.scores", (unsigned long long)hash);
+    *path = dir_ + "/" + name;
+    return true;
+}
+
+bool ScoreCache::Load(const string& movie_file, const vector<string>& labels,
+        ScoreMatrix* scores) const
+{
+    string path;
+    if(!Enabled() || !Path(movie_file, &path))
+        return false;
+
+    ifstream f(path.c_str(), ios::binary);
+    if(!f)
+        return false;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t rows, cols;
+    f.read(magic, sizeof(magic));
+    f.read((char*)&version, sizeof(version));
+    f.read((char*)&key, sizeof(key));
+    f.read((char*)&rows, sizeof(rows));
+    f.read((char*)&cols, sizeof(cols));
+    if(!f || memcmp(magic, kCacheMagic, sizeof(magic)) != 0 || version != kCacheVersion
+            || key != key_ || rows < 0 || cols != labels.size())
+        return false;
+
+    //a different label file means the columns mean something else
+    for(int i=0; i < cols; i++)
+    {
+        uint32_t size;
+        if(!f.read((char*)&size, sizeof(size)) || size != labels[i].size())
+            return false;
+        string label(size, '\0');
+        if(!f.read(&label[0], size) || label != labels[i])
+            return false;
+    }
+
+    ScoreMatrix cached(cols);
+    cached.Resize(rows);
+    if(rows > 0 && !f.read((char*)cached.row(0), (size_t)rows * cols * sizeof(float)))
+        return false;
+
+    *scores = cached;
+    return true;
+}
+
+void ScoreCache::Save(const string& movie_file, const vector<string>& labels,
+        const ScoreMatrix& scores) const
+{
+    string path;
+    if(!Enabled() || !Path(movie_file, &path))
+        return;
+
+    string mkdir_cmd = "mkdir -p \"" + dir_ + "\"";
+    if(system(mkdir_cmd.c_str()))
+    {
+        cerr << "Cannot create score cache: " << dir_ << endl;
+        return;
+    }
+
+    //write somewhere else and rename, so a run that is killed or
+    //another one reading the same entry never sees half a file
+    string temp_path = path + "." + to_string(getpid());
+    ofstream f(temp_path.c_str(), ios::binary);
+    if(!f)
+    {
+        cerr << "Cannot write score cache: " << temp_path << endl;
+        return;
+    }
+
+    int32_t rows = scores.rows();
+    int32_t cols = scores.cols();
+    f.write(kCacheMagic, sizeof(kCacheMagic));
+    f.write((const char*)&kCacheVersion, sizeof(kCacheVersion));
+    f.write((const char*)&key_, sizeof(key_));
+    f.write((const char*)&rows, sizeof(rows));
+    f.write((const char*)&cols, sizeof(cols));
+    for(int i=0; i < labels.size(); i++)
+    {
+        uint32_t size = labels[i].size();
+        f.write((const char*)&size, sizeof(size));
+        f.write(labels[i].data(), size);
+    }
+    if(rows > 0)
+        f.write((const char*)scores.data(), (size_t)rows * cols * sizeof(float));
+    f.close();
+
+    if(!f || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        cerr << "Cannot write score cache: " << path << endl;
+        remove(temp_path.c_str());
+    }
+}
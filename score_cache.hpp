@@ -0,0 +1,54 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef SCORE_CACHE_HPP
+#define SCORE_CACHE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cut_movie.hpp"
+
+using namespace std;
+
+//64 bit FNV-1a, seed with the hash of whatever came before
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+uint64_t HashString(const string& s, uint64_t seed = 14695981039346656037ULL);
+
+//hash the whole file (0 if it can't be read)
+uint64_t HashFile(const string& path, uint64_t seed = 14695981039346656037ULL);
+
+//hash the size and the start, middle and end of a movie, enough to
+//tell movies apart without reading gigabytes. False if it isn't a
+//regular file that can be read (a URL, a pipe, a device), as there is
+//nothing there that stays the same to hash.
+bool HashMovie(const string& path, uint64_t* hash, uint64_t seed = 14695981039346656037ULL);
+
+//The scores of movies already classified, one file per movie named after
+//the hash of its content. The key covers the model and anything else that
+//changes the scores, so the cut settings can be tuned without running
+//the network again. Movies that can't be hashed are never cached.
+class ScoreCache
+{
+ public:
+    //an empty dir turns the cache off
+    ScoreCache(const string& dir, uint64_t key);
+
+    bool Enabled() const { return dir_ != ""; }
+
+    bool Load(const string& movie_file, const vector<string>& labels, ScoreMatrix* scores) const;
+    void Save(const string& movie_file, const vector<string>& labels, const ScoreMatrix& scores) const;
+
+ private:
+    //false if the movie can't be cached
+    bool Path(const string& movie_file, string* path) const;
+
+    string dir_;
+    uint64_t key_;
+};
+
+//$XDG_CACHE_HOME/miles-deep or ~/.cache/miles-deep
+string DefaultCacheDirectory();
+
+#endif
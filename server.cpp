@@ -0,0 +1,212 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+
+#include "server.hpp"
+#include "cut_movie.hpp"
+#include "adaptive.hpp"
+#include "frame_grabber.hpp"
+#include "protocol.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+//how long a batch waits for more frames before it goes as it is
+static const int kBatchWaitMs = 20;
+
+struct ServerContext
+{
+    Classifier* classifier;
+    BatchScheduler* scheduler;
+    string temp_dir;
+};
+
+static void WriteCuts(LineSocket* sock, const CutList& cuts)
+{
+    ostringstream out;
+    for(int i=0; i < cuts.size(); i++)
+        out << "cut " << (cuts[i].label == "" ? "-" : cuts[i].label) << " " << cuts[i].s 
+            << " " << cuts[i].e << " " << cuts[i].score << " " << cuts[i].coverage << '\n';
+    sock->Write(out.str());
+}
+
+static void WriteScores(LineSocket* sock, const ScoreMatrix& scores)
+{
+    ostringstream out;
+    for(int i=0; i < scores.rows(); i++)
+    {
+        out << "row " << i << " ";
+        const float* row = scores.row(i);
+        for(int j=0; j < scores.cols(); j++)
+            out << (j ? "," : "") << row[j];
+        out << '\n';
+    }
+    sock->Write(out.str());
+}
+
+//decode the movie here and let the scheduler batch its frames
+//with everyone else's. False if the movie couldn't be read twice for
+//the second pass of sample_stride.
+static bool ScoreMovie(ServerContext* ctx, const JobRequest& request,
+        FrameGrabber* grabber, FrameGate* gate, ScoreMatrix* scores)
+{
+    int num_labels = ctx->classifier->labels_.size();
+    ctx->scheduler->Begin();
+    if(request.sample_stride > 1)
+        return ScoreMovieAdaptive(ctx->scheduler, grabber, num_labels, request.sample_stride,
+                request.min_score, boost::function<void(int)>(), scores, NULL);
+
+    ScoreJob job(num_labels);
+    SubmitMovie(ctx->scheduler, grabber, &job, gate, boost::function<void(int)>());
+    *scores = job.Wait();
+    return true;
+}
+
+static bool RunJob(ServerContext* ctx, LineSocket* sock, const JobRequest& request,
+        string* error)
+{
+    const vector<string>& labels = ctx->classifier->labels_;
+
+    //check the targets before spending any time on the movie
+    vector<int> target_ints;
+    if(request.mode == "cut")
+    {
+        for(int i=0; i < labels.size(); i++)
+        {
+            bool wanted = request.all_but_other ? labels[i] != "other" :
+                find(request.targets.begin(), request.targets.end(), labels[i]) 
+                != request.targets.end();
+            if(wanted)
+                target_ints.push_back(i);
+        }
+        if(!request.all_but_other && target_ints.size() != request.targets.size())
+        {
+            *error = "unknown target label";
+            return false;
+        }
+    }
+    else if(request.mode != "tag" && request.mode != "scores")
+    {
+        *error = "unknown mode: " + request.mode;
+        return false;
+    }
+
+    FrameGrabber grabber(request.movie_file);
+    if(!grabber.IsOpened())
+    {
+        *error = "can't open movie: " + request.movie_file;
+        return false;
+    }
+
+    cout << "Job: " << request.mode << " " << request.movie_file << endl;
+    FrameGate gate(request.skip_threshold);
+    ScoreMatrix scores;
+    if(!ScoreMovie(ctx, request, &grabber, &gate, &scores))
+    {
+        *error = "can't read back the seconds to refine, -e needs a movie that can be read twice";
+        return false;
+    }
+
+    ostringstream header;
+    header << "labels ";
+    for(int i=0; i < labels.size(); i++)
+        header << (i ? "," : "") << labels[i];
+    header << '\n' << "seconds " << scores.rows() << '\n';
+    header << "skipped " << gate.Skipped() << '\n';
+    sock->Write(header.str());
+
+    if(request.mode == "scores")
+    {
+        WriteScores(sock, scores);
+        return true;
+    }
+
+    //a movie that can't be cut fails this job, not the server
+    CutList cuts;
+    bool ok;
+    if(request.mode == "tag")
+        ok = TagTargets(scores, request.movie_file, request.output_dir, labels,
+                labels.size(), request.min_cut, request.max_gap, request.min_score,
+                request.min_coverage, &cuts, error);
+    else
+        ok = CutMovie(scores, request.movie_file, target_ints, request.output_dir,
+                ctx->temp_dir, labels.size(), request.min_cut, request.max_gap,
+                request.min_score, request.min_coverage, request.do_concat, false, 0,
+                &cuts, error);
+    if(ok)
+        WriteCuts(sock, cuts);
+    return ok;
+}
+
+static void HandleClient(ServerContext* ctx, int fd)
+{
+    LineSocket sock(fd);
+    JobRequest request;
+    string error;
+
+    if(ReadRequest(&sock, &request, &error) && RunJob(ctx, &sock, request, &error))
+        sock.Write("ok\n");
+    else
+    {
+        cerr << "Job failed: " << error << endl;
+        sock.Write("error " + error + "\n");
+    }
+    close(fd);
+}
+
+static void AcceptClients(ServerContext* ctx, int listen_fd)
+{
+    while(true)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            cerr << "Error accepting connection" << endl;
+            exit(EXIT_FAILURE);
+        }
+        boost::thread(HandleClient, ctx, fd).detach();
+    }
+}
+
+void RunServer(const string& socket_path, Classifier* classifier, int batch_size,
+        const string& temp_dir)
+{
+    //a client going away mid answer shouldn't take the server down
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = ListenSocket(socket_path);
+    if(listen_fd < 0)
+    {
+        cerr << "Cannot listen on socket: " << socket_path 
+            << " (is a server already running on it?)" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    //clients are waiting, so a short batch doesn't wait for long
+    BatchScheduler scheduler(classifier, batch_size, 4 * batch_size, kBatchWaitMs);
+    ServerContext ctx;
+    ctx.classifier = classifier;
+    ctx.scheduler = &scheduler;
+    ctx.temp_dir = temp_dir;
+
+    cout << "Listening on " << socket_path << endl;
+    boost::thread acceptor(AcceptClients, &ctx, listen_fd);
+
+    //the network stays on this thread
+    scheduler.Run();
+}
@@ -0,0 +1,20 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <string>
+#include "classifier.hpp"
+
+using namespace std;
+
+//Keep the classifier loaded and serve jobs from miles-deep-client on a
+//unix domain socket. The frames of all the clients are batched together
+//into the same forward passes. Never returns, and has to be called from
+//the thread that created the classifier.
+void RunServer(const string& socket_path, Classifier* classifier, int batch_size,
+        const string& temp_dir);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "stats.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+//samples kept per stage, enough for the 99th percentile to mean something
+static const int kMaxSamples = 10000;
+
+struct Samples
+{
+    Samples() : calls(0), items(0), total(0), max(0), seed(1) {}
+
+    long long calls;
+    long long items;
+    double total;
+    double max;
+    vector<float> kept;
+    unsigned int seed;
+};
+
+static boost::mutex stats_mutex;
+static map<string, Samples> stages;
+static map<string, Samples> values;
+static const chrono::steady_clock::time_point run_start = chrono::steady_clock::now();
+
+static void Add(Samples* s, double value, int items)
+{
+    s->calls++;
+    s->items += items;
+    s->total += value;
+    s->max = max(s->max, value);
+
+    //reservoir sampling, so the kept ones are a fair pick of all of them
+    if(s->kept.size() < kMaxSamples)
+        s->kept.push_back(value);
+    else
+    {
+        s->seed = s->seed * 1103515245 + 12345;
+        long long slot = (s->seed >> 8) % s->calls;
+        if(slot < kMaxSamples)
+            s->kept[slot] = value;
+    }
+}
+
+void RecordStage(const char* stage, double seconds, int items)
+{
+    boost::unique_lock<boost::mutex> lock(stats_mutex);
+    Add(&stages[stage], seconds, items);
+}
+
+void RecordValue(const char* name, double value)
+{
+    boost::unique_lock<boost::mutex> lock(stats_mutex);
+    Add(&values[name], value, 1);
+}
+
+static double Percentile(const vector<float>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+//one line of the report
+struct Row
+{
+    string kind;
+    string name;
+    long long calls;
+    long long items;
+    double total;
+    double mean, p50, p90, p99, max;
+};
+
+static Row Summarize(const string& kind, const string& name, const Samples& s, double scale)
+{
+    vector<float> sorted = s.kept;
+    sort(sorted.begin(), sorted.end());
+
+    Row row;
+    row.kind = kind;
+    row.name = name;
+    row.calls = s.calls;
+    row.items = s.items;
+    row.total = s.total;
+    row.mean = s.calls ? scale * s.total / s.calls : 0;
+    row.p50 = scale * Percentile(sorted, 0.50);
+    row.p90 = scale * Percentile(sorted, 0.90);
+    row.p99 = scale * Percentile(sorted, 0.99);
+    row.max = scale * s.max;
+    return row;
+}
+
+bool WriteStatsReport(const string& path)
+{
+    vector<Row> rows;
+    double wall;
+    {
+        boost::unique_lock<boost::mutex> lock(stats_mutex);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - run_start;
+        wall = elapsed.count();
+        for(map<string, Samples>::iterator it = stages.begin(); it != stages.end(); ++it)
+            rows.push_back(Summarize("stage", it->first, it->second, 1000.0));
+        for(map<string, Samples>::iterator it = values.begin(); it != values.end(); ++it)
+            rows.push_back(Summarize("value", it->first, it->second, 1.0));
+    }
+
+    ofstream f(path.c_str());
+    if(!f)
+        return false;
+
+    //stage times are in ms. items_per_s is over the time spent in the
+    //stage (summed over threads), items_per_wall_s over the whole run.
+    if(getFileExtension(path) == ".json")
+    {
+        f << "{\n  \"wall_s\": " << wall << ",\n  \"stages\": [";
+        for(int i=0; i < rows.size(); i++)
+        {
+            const Row& r = rows[i];
+            f << (i ? "," : "") << "\n    {\"kind\": \"" << r.kind << "\", \"name\": \"" << r.name
+                << "\", \"unit\": \"" << (r.kind == "stage" ? "ms" : "") 
+                << "\", \"calls\": " << r.calls << ", \"items\": " << r.items;
+            if(r.kind == "stage")
+                f << ", \"total_s\": " << r.total
+                    << ", \"items_per_s\": " << (r.total > 0 ? r.items / r.total : 0)
+                    << ", \"items_per_wall_s\": " << (wall > 0 ? r.items / wall : 0);
+            f << ", \"mean\": " << r.mean << ", \"p50\": " << r.p50 << ", \"p90\": " << r.p90
+                << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << "}";
+        }
+        f << "\n  ]\n}\n";
+    }
+    else
+    {
+        f << "kind,name,calls,items,total_s,items_per_s,items_per_wall_s,mean,p50,p90,p99,max\n";
+        for(int i=0; i < rows.size(); i++)
+        {
+            const Row& r = rows[i];
+            bool stage = r.kind == "stage";
+            f << r.kind << "," << r.name << "," << r.calls << "," << r.items << ",";
+            if(stage)
+                f << r.total << "," << (r.total > 0 ? r.items / r.total : 0) << ","
+                    << (wall > 0 ? r.items / wall : 0) << ",";
+            else
+                f << ",,,";
+            f << r.mean << "," << r.p50 << "," << r.p90 << "," << r.p99 << "," << r.max << "\n";
+        }
+        f << "run,wall,1,0," << wall << ",,,,,,,\n";
+    }
+
+    f.close();
+    return !f.fail();
+}
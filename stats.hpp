@@ -0,0 +1,48 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+//Timings of each stage of the pipeline (decode, preprocess, forward, the
+//cuts...), always collected and cheap enough to leave on: a lock and a few
+//adds per call, and at most kMaxSamples kept per stage for the percentiles.
+
+//one call of a stage took seconds and handled items (frames, cuts...)
+void RecordStage(const char* stage, double seconds, int items = 1);
+
+//a sample of something that isn't a time, like how full a queue is
+void RecordValue(const char* name, double value);
+
+//calls, items, percentiles and throughput of every stage since the start,
+//as JSON if path ends in .json and CSV otherwise. False if it can't write.
+bool WriteStatsReport(const string& path);
+
+//times its own lifetime as one call of a stage
+class StageTimer
+{
+ public:
+    explicit StageTimer(const char* stage, int items = 1)
+        : stage_(stage), items_(items), start_(chrono::steady_clock::now()) {}
+
+    ~StageTimer()
+    {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start_;
+        RecordStage(stage_, elapsed.count(), items_);
+    }
+
+    void SetItems(int items) { items_ = items; }
+
+ private:
+    const char* stage_;
+    int items_;
+    chrono::steady_clock::time_point start_;
+};
+
+#endif
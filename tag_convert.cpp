@@ -0,0 +1,103 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Converts tag files between the csv .tag and the binary .tagb formats,
+//whichever way the extension says. A .tag has no scores, so a .tagb
+//made from one only has the cuts.
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "tag_file.hpp"
+#include "util.hpp"
+
+using namespace std;
+
+void PrintUsage(char* prog_name)
+{
+    cout << "Usage: " << prog_name << " [-o output_dir] [-p] file.tag|file.tagb ..." << endl;
+    cout << endl;
+    cout << "-o\tOutput directory (default: same as input)" << endl;
+    cout << "-p\tPrint a summary of each file instead of converting it" << endl;
+}
+
+void PrintSummary(const string& path, const TagData& tags)
+{
+    cout << path << ": " << tags.movie << ", " << PrettyTime(tags.seconds) << ", "
+        << tags.labels.size() << " labels, " << tags.cuts.size() << " cuts"
+        << (tags.scores.rows() > 0 ? ", with scores" : "") << endl;
+    for(int j=0; j < tags.cuts.size(); j++)
+        cout << "  " << tags.cuts[j].label << " " << PrettyTime(tags.cuts[j].s) << " - "
+            << PrettyTime(tags.cuts[j].e) << " score= " << tags.cuts[j].score
+            << " coverage= " << tags.cuts[j].coverage << endl;
+}
+
+int main(int argc, char** argv)
+{
+    string output_dir = "";
+    bool print = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "o:ph")) != -1)
+    {
+        switch(opt) {
+        case 'o':
+            output_dir = optarg;
+            break;
+        case 'p':
+            print = true;
+            break;
+        default:
+            PrintUsage(argv[0]);
+            exit(opt == 'h' ? 0 : EXIT_FAILURE);
+        }
+    }
+
+    if(optind >= argc)
+    {
+        PrintUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int failed = 0;
+    for(int i=optind; i < argc; i++)
+    {
+        string path = argv[i];
+        bool binary = getFileExtension(path) == ".tagb";
+        if(!binary && getFileExtension(path) != ".tag")
+        {
+            cerr << "Not a tag file: " << path << endl;
+            failed++;
+            continue;
+        }
+
+        TagData tags;
+        if(!(binary ? ReadTagBinary(path, &tags) : ReadTagCsv(path, &tags)))
+        {
+            cerr << "Cannot read tag file: " << path << endl;
+            failed++;
+            continue;
+        }
+
+        if(print)
+        {
+            PrintSummary(path, tags);
+            continue;
+        }
+
+        string dir = output_dir == "" ? getDirectory(path) : output_dir;
+        string out = dir + "/" + getBaseName(getFileName(path)) + (binary ? ".tag" : ".tagb");
+        if(!(binary ? WriteTagCsv(out, tags) : WriteTagBinary(out, tags)))
+        {
+            cerr << "Cannot write tag file: " << out << endl;
+            failed++;
+            continue;
+        }
+        cout << path << " -> " << out << endl;
+    }
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tag_file.hpp"
+
+using namespace std;
+
+const char kTagMagic[4] = {'M', 'D', 'T', 'G'};
+
+static uint64_t Align(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static vector<string> SplitCsv(const string& line)
+{
+    stringstream ss(line);
+    string item;
+    vector<string> fields;
+    while(getline(ss, item, ','))
+        fields.push_back(item);
+    return fields;
+}
+
+bool WriteTagCsv(const string& path, const TagData& tags)
+{
+    ofstream f(path.c_str());
+    if(!f)
+        return false;
+
+    //header
+    f << tags.movie << ",";
+    for(int i=0; i < tags.labels.size(); i++)
+         f << tags.labels[i] << ",";
+    f << '\n';
+
+    //total length of the cuts of each label
+    vector<int> target_time(tags.labels.size(), 0);
+    for(int j=0; j < tags.cuts.size(); j++)
+        for(int i=0; i < tags.labels.size(); i++)
+            if(tags.cuts[j].label == tags.labels[i])
+                target_time[i] += tags.cuts[j].e - tags.cuts[j].s + 1;
+
+    f << tags.seconds << ",";
+    for(int i=0; i < target_time.size(); i++)
+        f << target_time[i] << ",";
+    f << '\n';
+
+    //cut list
+    f << "label,start,end,score,coverage" << '\n';
+    for(int j=0; j < tags.cuts.size(); j++)
+    {
+        const Cut& cut = tags.cuts[j];
+        f << cut.label << "," << cut.s << "," << cut.e
+            << "," << cut.score << "," << cut.coverage << '\n';
+    }
+
+    f.close();
+    return !f.fail();
+}
+
+bool ReadTagCsv(const string& path, TagData* tags)
+{
+    ifstream f(path.c_str());
+    string header, totals, columns;
+    if(!getline(f, header) || !getline(f, totals) || !getline(f, columns))
+        return false;
+
+    //there is a total for every label, the movie name can have commas
+    vector<string> names = SplitCsv(header);
+    int num_labels = (int)SplitCsv(totals).size() - 1;
+    if(num_labels < 0 || names.size() < num_labels + 1)
+        return false;
+
+    tags->movie = names[0];
+    for(int i=1; i < names.size() - num_labels; i++)
+        tags->movie += "," + names[i];
+    tags->labels.assign(names.end() - num_labels, names.end());
+    tags->seconds = atoi(totals.c_str());
+    tags->scores = ScoreMatrix(num_labels);
+    tags->cuts.clear();
+
+    string line;
+    while(getline(f, line))
+    {
+        vector<string> fields = SplitCsv(line);
+        if(fields.size() != 5)
+            return false;
+
+        Cut cut;
+        cut.label = fields[0];
+        cut.s = atoi(fields[1].c_str());
+        cut.e = atoi(fields[2].c_str());
+        cut.score = atof(fields[3].c_str());
+        cut.coverage = atof(fields[4].c_str());
+        tags->cuts.push_back(cut);
+    }
+    return true;
+}
+
+bool WriteTagBinary(const string& path, const TagData& tags)
+{
+    int num_labels = tags.labels.size();
+    bool has_scores = tags.scores.rows() > 0;
+
+    vector<int32_t> cut_labels(tags.cuts.size(), -1);
+    for(int j=0; j < tags.cuts.size(); j++)
+        for(int i=0; i < num_labels; i++)
+            if(tags.cuts[j].label == tags.labels[i])
+                cut_labels[j] = i;
+
+    TagHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kTagMagic, sizeof(kTagMagic));
+    header.version = kTagVersion;
+    header.num_labels = num_labels;
+    header.num_seconds = tags.seconds;
+    header.num_cuts = tags.cuts.size();
+
+    uint64_t offset = sizeof(header);
+    header.names_offset = offset;
+    for(int i=0; i < num_labels; i++)
+        offset += tags.labels[i].size() + 1;
+    offset += tags.movie.size() + 1;
+
+    if(has_scores)
+    {
+        header.scores_offset = Align(offset, 64);
+        offset = header.scores_offset + (uint64_t)tags.scores.rows() * num_labels * sizeof(float);
+    }
+    header.cuts_offset = Align(offset, 8);
+    header.file_size = header.cuts_offset + tags.cuts.size() * sizeof(TagCut);
+
+    //build the whole file and write it at once
+    vector<char> buf(header.file_size, 0);
+    memcpy(&buf[0], &header, sizeof(header));
+
+    char* names = &buf[header.names_offset];
+    for(int i=0; i < num_labels; i++)
+    {
+        memcpy(names, tags.labels[i].c_str(), tags.labels[i].size() + 1);
+        names += tags.labels[i].size() + 1;
+    }
+    memcpy(names, tags.movie.c_str(), tags.movie.size() + 1);
+
+    if(has_scores)
+        memcpy(&buf[header.scores_offset], tags.scores.data(),
+                (size_t)tags.scores.rows() * num_labels * sizeof(float));
+
+    TagCut* cuts = (TagCut*)&buf[header.cuts_offset];
+    for(int j=0; j < tags.cuts.size(); j++)
+    {
+        cuts[j].label = cut_labels[j];
+        cuts[j].start = tags.cuts[j].s;
+        cuts[j].end = tags.cuts[j].e;
+        cuts[j].score = tags.cuts[j].score;
+        cuts[j].coverage = tags.cuts[j].coverage;
+    }
+
+    ofstream f(path.c_str(), ios::binary);
+    if(!f)
+        return false;
+    f.write(&buf[0], buf.size());
+    f.close();
+    return !f.fail();
+}
+
+bool ReadTagBinary(const string& path, TagData* tags)
+{
+    TagFile file;
+    if(!file.Open(path))
+        return false;
+
+    const TagHeader& header = file.Header();
+    tags->movie = file.MovieName();
+    tags->labels.clear();
+    for(int i=0; i < header.num_labels; i++)
+        tags->labels.push_back(file.Label(i));
+    tags->seconds = header.num_seconds;
+
+    tags->scores = ScoreMatrix(header.num_labels);
+    if(file.Scores())
+        tags->scores.AppendRows(file.Scores(), header.num_seconds);
+
+    tags->cuts.clear();
+    for(int j=0; j < header.num_cuts; j++)
+    {
+        const TagCut& tag_cut = file.Cuts()[j];
+        Cut cut;
+        cut.label = tag_cut.label >= 0 ? tags->labels[tag_cut.label] : "";
+        cut.s = tag_cut.start;
+        cut.e = tag_cut.end;
+        cut.score = tag_cut.score;
+        cut.coverage = tag_cut.coverage;
+        tags->cuts.push_back(cut);
+    }
+    return true;
+}
+
+
+TagFile::TagFile() : data_(NULL), size_(0)
+{
+}
+
+TagFile::~TagFile()
+{
+    Close();
+}
+
+bool TagFile::Open(const string& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= sizeof(TagHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    data_ = (const char*)map;
+    size_ = st.st_size;
+
+    //check every section is inside the file before handing out pointers
+    const TagHeader& header = Header();
+    uint64_t names_end = header.scores_offset ? header.scores_offset : header.cuts_offset;
+    uint64_t scores_size = (uint64_t)header.num_seconds * header.num_labels * sizeof(float);
+    uint64_t cuts_size = (uint64_t)header.num_cuts * sizeof(TagCut);
+    bool valid = memcmp(header.magic, kTagMagic, sizeof(kTagMagic)) == 0
+        && header.version == kTagVersion
+        && header.file_size == size_
+        && header.names_offset >= sizeof(TagHeader) && names_end <= size_
+        && header.names_offset <= names_end
+        && (!header.scores_offset || header.scores_offset % sizeof(float) == 0)
+        && (!header.scores_offset || header.scores_offset + scores_size <= header.cuts_offset)
+        && header.cuts_offset % sizeof(int32_t) == 0
+        && header.cuts_offset + cuts_size <= size_;
+
+    const char* name = data_ + header.names_offset;
+    const char* end = data_ + names_end;
+    for(int i=0; valid && i <= header.num_labels; i++)
+    {
+        const char* nul = (const char*)memchr(name, '\0', end - name);
+        if(!nul)
+            valid = false;
+        else
+        {
+            names_.push_back(name);
+            name = nul + 1;
+        }
+    }
+
+    for(int j=0; valid && j < header.num_cuts; j++)
+        if(Cuts()[j].label >= (int32_t)header.num_labels)
+            valid = false;
+
+    if(!valid)
+        Close();
+    return valid;
+}
+
+void TagFile::Close()
+{
+    if(data_)
+        munmap((void*)data_, size_);
+    data_ = NULL;
+    size_ = 0;
+    names_.clear();
+}
+
+const float* TagFile::Scores() const
+{
+    const TagHeader& header = Header();
+    return header.scores_offset ? (const float*)(data_ + header.scores_offset) : NULL;
+}
+
+const TagCut* TagFile::Cuts() const
+{
+    return (const TagCut*)(data_ + Header().cuts_offset);
+}
@@ -0,0 +1,91 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef TAG_FILE_HPP
+#define TAG_FILE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cut_movie.hpp"
+
+using namespace std;
+
+//Binary tag file (.tagb), written next to the .tag file. It is meant to be
+//mmapped and used in place, so everything is in host byte order (little
+//endian on anything miles-deep runs on) at fixed offsets:
+//
+//  TagHeader
+//  names:  num_labels NUL terminated labels, then the movie file name
+//  scores: num_seconds rows of num_labels floats, 64 byte aligned
+//          (scores_offset is 0 when converted from a .tag that has none)
+//  cuts:   num_cuts TagCuts sorted by start, 8 byte aligned
+
+const uint32_t kTagVersion = 1;
+
+struct TagHeader
+{
+    char magic[4];          //"MDTG"
+    uint32_t version;
+    uint32_t num_labels;
+    uint32_t num_seconds;
+    uint32_t num_cuts;
+    uint32_t reserved;
+    uint64_t names_offset;
+    uint64_t scores_offset;
+    uint64_t cuts_offset;
+    uint64_t file_size;
+};
+
+struct TagCut
+{
+    int32_t label;          //index into the labels
+    int32_t start;          //seconds, inclusive
+    int32_t end;
+    float score;
+    float coverage;
+};
+
+//everything in a tag file, in either format
+struct TagData
+{
+    string movie;
+    vector<string> labels;
+    int seconds;
+    ScoreMatrix scores;     //no rows when the scores aren't known
+    CutList cuts;
+};
+
+bool WriteTagCsv(const string& path, const TagData& tags);
+bool ReadTagCsv(const string& path, TagData* tags);
+bool WriteTagBinary(const string& path, const TagData& tags);
+bool ReadTagBinary(const string& path, TagData* tags);
+
+//read only view of a .tagb through mmap, nothing is parsed or copied
+class TagFile
+{
+ public:
+    TagFile();
+    ~TagFile();
+
+    //false if the file can't be mapped or isn't a valid tag file
+    bool Open(const string& path);
+    void Close();
+
+    const TagHeader& Header() const { return *(const TagHeader*)data_; }
+    const char* Label(int i) const { return names_[i]; }
+    const char* MovieName() const { return names_.back(); }
+    const float* Scores() const;
+    const TagCut* Cuts() const;
+
+ private:
+    TagFile(const TagFile&);
+    TagFile& operator=(const TagFile&);
+
+    const char* data_;
+    size_t size_;
+    vector<const char*> names_;
+};
+
+#endif
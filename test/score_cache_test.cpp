@@ -0,0 +1,91 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+//Checks of the score cache that need neither Caffe nor a movie. Prints
+//each check that fails and exits with 1 if any did.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../score_cache.hpp"
+#include "../util.hpp"
+
+using namespace std;
+
+static int failures = 0;
+
+static void Check(bool ok, const string& what)
+{
+    if(!ok)
+    {
+        cerr << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+static ScoreMatrix Scores(float value)
+{
+    ScoreMatrix scores(2);
+    scores.Resize(3);
+    for(int i=0; i < 3; i++)
+    {
+        scores.row(i)[0] = value;
+        scores.row(i)[1] = 1 - value;
+    }
+    return scores;
+}
+
+int main()
+{
+    string dir = makeTempDirectory("/tmp", "score_cache_test");
+    if(dir == "")
+    {
+        cerr << "Cannot make a temp directory" << endl;
+        return 1;
+    }
+
+    vector<string> labels = {"a", "b"};
+    ScoreCache cache(dir + "/cache", 1234);
+    ScoreMatrix loaded;
+
+    //a regular file is cached
+    string movie = dir + "/movie.mp4";
+    ofstream(movie.c_str()) << "not really a movie";
+    cache.Save(movie, labels, Scores(0.25));
+    Check(cache.Load(movie, labels, &loaded) && loaded.rows() == 3 && loaded.row(0)[0] == 0.25f,
+            "a saved movie loads its scores");
+
+    //inputs that can't be hashed never share an entry, or are cached at all
+    string missing_a = dir + "/missing_a.mp4";
+    string missing_b = dir + "/missing_b.mp4";
+    string url = "http://localhost/movie.mp4";
+    cache.Save(missing_a, labels, Scores(0.75));
+    cache.Save(url, labels, Scores(0.75));
+    Check(!cache.Load(missing_a, labels, &loaded), "an unreadable path isn't cached");
+    Check(!cache.Load(missing_b, labels, &loaded), "two unreadable paths don't share scores");
+    Check(!cache.Load(url, labels, &loaded), "a URL isn't cached");
+
+    string fifo = dir + "/pipe";
+    Check(mkfifo(fifo.c_str(), 0600) == 0, "make a fifo");
+    cache.Save(fifo, labels, Scores(0.75));
+    Check(!cache.Load(fifo, labels, &loaded), "a pipe isn't cached");
+
+    uint64_t hash;
+    Check(!HashMovie(missing_a, &hash) && !HashMovie(fifo, &hash) && !HashMovie(dir, &hash),
+            "only regular files are hashed");
+    Check(HashMovie(movie, &hash), "a regular file is hashed");
+
+    string rm_cmd = "rm -rf \"" + dir + "\"";
+    if(system(rm_cmd.c_str()))
+        cerr << "Cannot remove: " << dir << endl;
+
+    if(failures == 0)
+        cout << "score cache: all checks passed" << endl;
+    return failures ? 1 : 0;
+}
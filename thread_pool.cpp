@@ -0,0 +1,77 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include "thread_pool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads < 1 ? 1 : num_threads), fn_(NULL),
+      next_(0), end_(0), remaining_(0), stop_(false)
+{
+    //the caller works too, so one less thread to start
+    for(int i=1; i < num_threads_; i++)
+        threads_.create_thread(boost::bind(&ThreadPool::Worker, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        stop_ = true;
+        work_ready_.notify_all();
+    }
+    threads_.join_all();
+}
+
+//take the next index and run it, the lock is released while working
+bool ThreadPool::RunOne(boost::unique_lock<boost::mutex>& lock)
+{
+    if(next_ >= end_)
+        return false;
+
+    int i = next_++;
+    const boost::function<void(int)>* fn = fn_;
+    lock.unlock();
+    (*fn)(i);
+    lock.lock();
+
+    if(--remaining_ == 0)
+        work_done_.notify_all();
+    return true;
+}
+
+void ThreadPool::Worker()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(true)
+    {
+        while(!stop_ && next_ >= end_)
+            work_ready_.wait(lock);
+        if(stop_)
+            return;
+
+        RunOne(lock);
+    }
+}
+
+void ThreadPool::ParallelFor(int n, const boost::function<void(int)>& fn)
+{
+    if(n <= 0)
+        return;
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    fn_ = &fn;
+    next_ = 0;
+    end_ = n;
+    remaining_ = n;
+    work_ready_.notify_all();
+
+    while(RunOne(lock));
+
+    while(remaining_ > 0)
+        work_done_.wait(lock);
+    fn_ = NULL;
+    end_ = 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+//a fixed set of worker threads that are kept alive between calls.
+//ParallelFor runs fn(0) ... fn(n-1) spread over the workers plus the
+//calling thread and returns when all of them are done. Only one thread
+//should call ParallelFor at a time.
+class ThreadPool
+{
+ public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    void ParallelFor(int n, const boost::function<void(int)>& fn);
+
+    //total threads doing work, including the caller
+    int Size() const { return num_threads_; }
+
+ private:
+    void Worker();
+    bool RunOne(boost::unique_lock<boost::mutex>& lock);
+
+    int num_threads_;
+    boost::thread_group threads_;
+    boost::mutex mutex_;
+    boost::condition_variable work_ready_;
+    boost::condition_variable work_done_;
+    const boost::function<void(int)>* fn_;
+    int next_;
+    int end_;
+    int remaining_;
+    bool stop_;
+};
+
+#endif
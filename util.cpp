@@ -11,19 +11,64 @@
 #include <algorithm>
 #include <fstream>
 #include <string>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "util.hpp"
 
 using namespace std;
 
-float scoreMax(vector<float> x)
+float scoreMax(const float* x, int n)
 {
-     return *max_element(x.begin(), x.end());
+     return *max_element(x, x + n);
 }
 
-int scoreArgMax(vector<float> x)
+int scoreArgMax(const float* x, int n)
 {
-    return distance(x.begin(), max_element(x.begin(), x.end()));
+    return distance(x, max_element(x, x + n));
+}
+
+//argmax and max of every row of a row-major matrix. Works on four rows
+//at a time with SSE, keeping the first max like max_element does.
+void scoreArgMaxRows(const float* x, int rows, int cols, int* winners, float* vals)
+{
+    int r = 0;
+
+#ifdef __SSE2__
+    for( ; r + 4 <= rows; r += 4)
+    {
+        const float* p = x + (size_t)r * cols;
+        __m128 best = _mm_setr_ps(p[0], p[cols], p[2*cols], p[3*cols]);
+        __m128i arg = _mm_setzero_si128();
+        for(int c=1; c < cols; c++)
+        {
+            __m128 v = _mm_setr_ps(p[c], p[cols+c], p[2*cols+c], p[3*cols+c]);
+            __m128 gt = _mm_cmpgt_ps(v, best);
+            __m128i gt_i = _mm_castps_si128(gt);
+            best = _mm_or_ps(_mm_and_ps(gt, v), _mm_andnot_ps(gt, best));
+            arg = _mm_or_si128(_mm_and_si128(gt_i, _mm_set1_epi32(c)), 
+                    _mm_andnot_si128(gt_i, arg));
+        }
+        _mm_storeu_ps(vals + r, best);
+        _mm_storeu_si128((__m128i*)(winners + r), arg);
+    }
+#endif
+
+    for( ; r < rows; r++)
+    {
+        const float* p = x + (size_t)r * cols;
+        winners[r] = scoreArgMax(p, cols);
+        vals[r] = p[winners[r]];
+    }
 }
 
 string getFileName(const string& s)
@@ -100,3 +145,123 @@ std::string getDirectory (const std::string& path)
         return(path.substr(0, found));
 }
 
+bool isDirectory(const string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+//sorted paths of the regular files in a directory (not recursive)
+vector<string> listDirectory(const string& path)
+{
+    vector<string> files;
+    DIR *dir = opendir(path.c_str());
+    if(dir == NULL)
+    {
+        cerr << "Could not open directory: " << path << endl;
+        return files;
+    }
+
+    struct dirent *ent;
+    while((ent = readdir(dir)) != NULL)
+    {
+        string file = path + "/" + ent->d_name;
+        struct stat st;
+        if(stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            files.push_back(file);
+    }
+    closedir(dir);
+
+    sort(files.begin(), files.end());
+    return files;
+}
+
+//create a new uniquely named directory parent/prefix.XXXXXX
+//and return its path ("" on failure)
+string makeTempDirectory(const string& parent, const string& prefix)
+{
+    string mkdir_cmd = "mkdir -p \"" + parent + "\"";
+    if(system(mkdir_cmd.c_str()))
+        return "";
+
+    string path_template = parent + "/" + prefix + ".XXXXXX";
+    vector<char> path(path_template.begin(), path_template.end());
+    path.push_back('\0');
+    if(mkdtemp(&path[0]) == NULL)
+        return "";
+    return string(&path[0]);
+}
+
+//fork and exec a program (looked up in PATH) without a shell, so nothing
+//in the arguments needs quoting. stdin is /dev/null so several can run
+//at once without fighting over the terminal. Returns the pid or -1.
+pid_t startProcess(const vector<string>& args)
+{
+    //everything exec needs is built before the fork
+    vector<char*> argv;
+    for(int i=0; i < args.size(); i++)
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(NULL);
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if(null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+//wait for a process from startProcess, its exit status or -1 if it
+//didn't exit normally
+int waitProcess(pid_t pid)
+{
+    int status;
+    while(waitpid(pid, &status, 0) < 0)
+        if(errno != EINTR)
+            return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+//size of a file in bytes, -1 if it isn't there
+long long fileSize(const string& path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return -1;
+    return st.st_size;
+}
+
+//a memory line of /proc/self/status in MB, 0 if there isn't one
+static double statusMemoryMB(const string& field)
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while(getline(status, line))
+        if(line.compare(0, field.size(), field) == 0)
+            return atof(line.c_str() + field.size()) / 1024.0;
+    return 0;
+}
+
+//resident memory of this process now and at its highest
+double residentMemoryMB()
+{
+    return statusMemoryMB("VmRSS:");
+}
+
+double peakMemoryMB()
+{
+    return statusMemoryMB("VmHWM:");
+}
+
+//cores this process is allowed to run on
+int usableCores()
+{
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0)
+        return max(1, CPU_COUNT(&set));
+    return max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+}
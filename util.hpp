@@ -9,17 +9,29 @@
 #include <cstdio>
 #include <cstdlib>
 #include <vector>
+#include <string>
+#include <sys/types.h>
 
 using namespace std;
 
 
-float scoreMax(vector<float> x);
-int scoreArgMax(vector<float> x);
+float scoreMax(const float* x, int n);
+int scoreArgMax(const float* x, int n);
+void scoreArgMaxRows(const float* x, int rows, int cols, int* winners, float* vals);
 string getFileName(const string& s);
 string getFileExtension(const string& s);
 string getBaseName(const string& s);
 bool queryYesNo();
 string PrettyTime(int seconds);
 string getDirectory(const string& path);
+bool isDirectory(const string& path);
+vector<string> listDirectory(const string& path);
+string makeTempDirectory(const string& parent, const string& prefix);
+pid_t startProcess(const vector<string>& args);
+int waitProcess(pid_t pid);
+long long fileSize(const string& path);
+double residentMemoryMB();
+double peakMemoryMB();
+int usableCores();
 
 #endif
@@ -0,0 +1,224 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "util.hpp"
+#include "workers.hpp"
+
+using namespace std;
+
+//cores in a sysfs list like 0-7,16-23
+static vector<int> ParseCoreList(const string& list)
+{
+    vector<int> cores;
+    stringstream ss(list);
+    string range;
+    while(getline(ss, range, ','))
+    {
+        int first, last;
+        if(sscanf(range.c_str(), "%d-%d", &first, &last) == 2)
+            for(int c=first; c <= last; c++)
+                cores.push_back(c);
+        else if(sscanf(range.c_str(), "%d", &first) == 1)
+            cores.push_back(first);
+    }
+    return cores;
+}
+
+vector<vector<int> > NumaNodes()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        for(int c=0; c < sysconf(_SC_NPROCESSORS_ONLN) && c < CPU_SETSIZE; c++)
+            CPU_SET(c, &allowed);
+
+    vector<vector<int> > nodes;
+    for(int n=0; ; n++)
+    {
+        string path = "/sys/devices/system/node/node" + to_string(n) + "/cpulist";
+        ifstream f(path.c_str());
+        string list;
+        if(!f || !getline(f, list))
+            break;
+
+        //leave out the cores we aren't allowed on, and nodes with none
+        vector<int> cores;
+        vector<int> listed = ParseCoreList(list);
+        for(int i=0; i < listed.size(); i++)
+            if(listed[i] < CPU_SETSIZE && CPU_ISSET(listed[i], &allowed))
+                cores.push_back(listed[i]);
+        if(!cores.empty())
+            nodes.push_back(cores);
+    }
+
+    if(nodes.empty())
+    {
+        vector<int> cores;
+        for(int c=0; c < CPU_SETSIZE; c++)
+            if(CPU_ISSET(c, &allowed))
+                cores.push_back(c);
+        nodes.push_back(cores);
+    }
+    return nodes;
+}
+
+vector<vector<int> > WorkerCores(int n)
+{
+    vector<vector<int> > nodes = NumaNodes();
+    if(n <= 0)
+        n = nodes.size();
+
+    vector<vector<int> > workers(n);
+    for(int node=0; node < nodes.size(); node++)
+    {
+        //the workers on this node: node, node + nodes, ...
+        vector<int> on_node;
+        for(int w=node; w < n; w += nodes.size())
+            on_node.push_back(w);
+
+        const vector<int>& cores = nodes[node];
+        for(int i=0; i < on_node.size(); i++)
+        {
+            int first = cores.size() * i / on_node.size();
+            int last = cores.size() * (i + 1) / on_node.size();
+            if(first == last)  //more workers than cores, they share
+                last = first + 1;
+            workers[on_node[i]].assign(cores.begin() + first, cores.begin() + last);
+        }
+    }
+    return workers;
+}
+
+string CoreList(const vector<int>& cores)
+{
+    ostringstream list;
+    for(int i=0; i < cores.size(); i++)
+    {
+        int j = i;
+        while(j + 1 < cores.size() && cores[j + 1] == cores[j] + 1)
+            j++;
+        list << (i ? "," : "") << cores[i];
+        if(j > i)
+            list << "-" << cores[j];
+        i = j;
+    }
+    return list.str();
+}
+
+bool WorkerPool::Fork(const vector<vector<int> >& cores)
+{
+    //or it is printed again by every worker
+    cout << flush;
+    cerr << flush;
+
+    for(int w=0; w < cores.size(); w++)
+    {
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        {
+            cerr << "Cannot create a socket for worker " << w << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            cerr << "Cannot start worker " << w << endl;
+            exit(EXIT_FAILURE);
+        }
+        if(pid == 0)
+        {
+            //the other workers' sockets aren't ours
+            for(int i=0; i < fds_.size(); i++)
+                close(fds_[i]);
+            fds_.clear();
+            close(sv[0]);
+            fd_ = sv[1];
+            worker_ = w;
+            cores_ = cores[w];
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(int i=0; i < cores_.size(); i++)
+                CPU_SET(cores_[i], &set);
+            if(sched_setaffinity(0, sizeof(set), &set) != 0)
+                cerr << "Worker " << w << " can't be pinned to cores " << CoreList(cores_) << endl;
+            return true;
+        }
+
+        close(sv[1]);
+        pids_.push_back(pid);
+        fds_.push_back(sv[0]);
+    }
+    return false;
+}
+
+int WorkerPool::Serve(int jobs)
+{
+    vector<pollfd> open;
+    for(int i=0; i < fds_.size(); i++)
+    {
+        pollfd p = {fds_[i], POLLIN, 0};
+        open.push_back(p);
+    }
+
+    //each request is one byte, answered with the next job
+    int next = 0;
+    while(!open.empty())
+    {
+        if(poll(&open[0], open.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            cerr << "Lost the workers" << endl;
+            break;
+        }
+
+        for(int i=open.size() - 1; i >= 0; i--)
+        {
+            if(open[i].revents == 0)
+                continue;
+            char request;
+            int32_t job = next < jobs ? next : -1;
+            if(recv(open[i].fd, &request, 1, 0) != 1 ||
+                    send(open[i].fd, &job, sizeof(job), MSG_NOSIGNAL) != sizeof(job))
+            {
+                close(open[i].fd);
+                open.erase(open.begin() + i);
+            }
+            else if(job >= 0)
+                next++;
+        }
+    }
+
+    int failed = 0;
+    for(int i=0; i < pids_.size(); i++)
+        if(waitProcess(pids_[i]) != 0)
+            failed++;
+    return failed;
+}
+
+int WorkerPool::NextJob()
+{
+    char request = 'n';
+    int32_t job;
+    if(send(fd_, &request, 1, MSG_NOSIGNAL) != 1 ||
+            recv(fd_, &job, sizeof(job), MSG_WAITALL) != sizeof(job))
+        return -1;
+    return job;
+}
@@ -0,0 +1,58 @@
+/*
+ * Covered by the GPL. v3 (see included LICENSE)
+ */
+
+#ifndef WORKERS_HPP
+#define WORKERS_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+using namespace std;
+
+//the cores of each NUMA node that this process may run on, from sysfs.
+//One node with all of them if the machine doesn't have NUMA.
+vector<vector<int> > NumaNodes();
+
+//cores for n workers (0 for one per NUMA node): spread over the nodes in
+//turn, the cores of a node split evenly between the workers on it
+vector<vector<int> > WorkerCores(int n);
+
+//cores as a short list like 0-7,16-23
+string CoreList(const vector<int>& cores);
+
+//Worker processes that take jobs, the numbers 0 to jobs-1, from the
+//parent one at a time, so one with long movies doesn't hold up the rest.
+//Each one is pinned to its cores before it loads anything, so the memory
+//it touches (the weights of its own copy of the model) is on its node.
+//Fork before any threads are started.
+class WorkerPool
+{
+ public:
+    WorkerPool() : worker_(-1), fd_(-1) {}
+
+    //fork a worker for each set of cores. True in the workers, false
+    //in the parent.
+    bool Fork(const vector<vector<int> >& cores);
+
+    //in the parent: hand out the jobs until every worker has exited,
+    //returns how many of them failed
+    int Serve(int jobs);
+
+    //in a worker: the next job, -1 once they are all taken
+    int NextJob();
+
+    //this worker's number and cores
+    int Worker() const { return worker_; }
+    const vector<int>& Cores() const { return cores_; }
+
+ private:
+    int worker_;
+    int fd_;
+    vector<int> cores_;
+    vector<pid_t> pids_;
+    vector<int> fds_;
+};
+
+#endif